@@ -0,0 +1,155 @@
+//////
+//This class saves the histograms of every input file dmcHist has finished
+//in a checkpoint directory, one small root file per input file. When
+//dmcHist is run again (after new files were added to the text file, or
+//after a run died half way through) the files that already have a
+//checkpoint are not read again: their histograms are loaded from the
+//checkpoint and added to the total in the same place as before, so the
+//result is the same as a clean run over every file.
+//
+//A checkpoint is named after a hash of the input file's path, size and
+//modification time, and of everything else that changes its histograms
+//(the number of bins, the range size, the cuts, and if it is data), so a
+//file that changed is simply read again. Files that were skipped because
+//they are empty get a checkpoint too, so they aren't opened again either;
+//files that couldn't be opened or read don't, so they are tried again.
+//////
+
+#ifndef CHECKPOINTSTORE_H
+#define CHECKPOINTSTORE_H
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <unistd.h>
+#include "TSystem.h"
+#include "TFile.h"
+#include "TString.h"
+#include "TParameter.h"
+#include "HistSet.h"
+
+
+class CheckpointStore
+{
+ public:
+  CheckpointStore(const TString &dir, int nbins, Long64_t rangeEntries, const std::string &cuts);
+
+  bool load(const TString &path, bool isData, HistSet *&hists);
+  void save(const TString &path, bool isData, const HistSet *hists);
+  void report();
+
+ private:
+  TString checkpointName(const TString &path, bool isData);
+
+  TString dir;
+  int nbins;
+  Long64_t rangeEntries;
+  std::string cuts;             //The event selection, as text
+
+  int reused, reprocessed, saved;
+  std::mutex lock;
+};
+
+
+CheckpointStore::CheckpointStore(const TString &dir_in, int nbins_in, Long64_t rangeEntries_in, const std::string &cuts_in)
+  : dir(dir_in), nbins(nbins_in), rangeEntries(rangeEntries_in), cuts(cuts_in), reused(0), reprocessed(0), saved(0)
+{
+  gSystem->mkdir(dir, kTRUE);
+}
+
+
+/*
+  Looks for the checkpoint of an input file. Returns true if there is one,
+  with hists set to its histograms (or to 0 if the file was skipped).
+*/
+bool CheckpointStore::load(const TString &path, bool isData, HistSet *&hists)
+{
+  hists = 0;
+  TString name = checkpointName(path, isData);
+
+  TFile *f = 0;
+  if (name.Length() > 0 && !gSystem->AccessPathName(name)) f = TFile::Open(name, "READ");
+
+  bool found = false;
+  if (f && !f->IsZombie())
+    {
+      if (f->Get("skipped")) found = true;
+      else
+	{
+	  hists = new HistSet(nbins);
+	  found = hists->read(f);
+	  if (!found) { delete hists; hists = 0; }
+	}
+    }
+  delete f;
+
+  std::lock_guard<std::mutex> guard(lock);
+  if (found) ++reused;
+  else ++reprocessed;
+  return found;
+}
+
+
+/*
+  Saves the histograms of a finished input file (0 if it was skipped). The
+  checkpoint is written under a temporary name and renamed when complete,
+  so a run that dies while writing it never leaves a broken checkpoint.
+*/
+void CheckpointStore::save(const TString &path, bool isData, const HistSet *hists)
+{
+  TString name = checkpointName(path, isData);
+  if (name.Length() == 0) return;
+
+  std::stringstream tmp;
+  tmp << name << ".part" << getpid() << "_" << std::hash<std::thread::id>()(std::this_thread::get_id());
+
+  TDirectory *prevDir = gDirectory;
+  TFile *f = TFile::Open(tmp.str().c_str(), "RECREATE");
+  if (!f || f->IsZombie()) { delete f; return; }
+
+  if (hists) hists->write(f);
+  else { f->cd(); TParameter<int> skipped("skipped", 1); skipped.Write(); }
+  f->Close();
+  delete f;
+  prevDir->cd();
+
+  if (gSystem->Rename(tmp.str().c_str(), name) != 0) { gSystem->Unlink(tmp.str().c_str()); return; }
+
+  std::lock_guard<std::mutex> guard(lock);
+  ++saved;
+}
+
+
+/*
+  Name of the checkpoint of an input file, empty if the file isn't there
+*/
+TString CheckpointStore::checkpointName(const TString &path, bool isData)
+{
+  FileStat_t stat;
+  if (gSystem->GetPathInfo(path, stat) != 0) return TString();
+
+  std::stringstream key, name;
+  key << path << "|" << stat.fSize << "|" << stat.fMtime << "|" << nbins << "|" << rangeEntries << "|" << isData << "|" << cuts;
+  name << dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+       << std::hash<std::string>()(key.str()) << "_" << gSystem->BaseName(path);
+  return TString(name.str());
+}
+
+
+/*
+  Prints how many input files were taken from checkpoints
+*/
+void CheckpointStore::report()
+{
+  std::cout << "Checkpoints (" << dir << "): "
+	    << reused << " files reused, " << reprocessed << " reprocessed, "
+	    << saved << " saved" << std::endl;
+}
+
+
+
+#endif /*CHECKPOINTSTORE_H*/
@@ -0,0 +1,322 @@
+//////
+//These classes work out quantities that aren't branches of the tree, from
+//the jets TreeConnector reads:
+//
+//  dR12    Delta R between the two leading large jets
+//  mjj     invariant mass of the two leading large jets
+//  HT      scalar sum of the Pt of all the small jets
+//  nJets   number of small jets
+//  nMatched(i), matchedPt(i)
+//          number of small jets matched to large jet i (see JetMatcher.h),
+//          and the Pt of the leading one, for the nLeading leading large
+//          jets
+//
+//dR12 and mjj only exist for events with at least two large jets.
+//
+//DerivedVars does it for the event loaded in a TreeConnector. A value is
+//only worked out the first time it is asked for and then kept, so several
+//histograms can use it; make a new DerivedVars (it is tiny) for every
+//event, with a JetMatcher that the caller keeps. DerivedColumns does the
+//same for every event of an EventBatch at once: the leading jets are
+//copied into contiguous arrays and each quantity is worked out in one loop
+//over the events, which the compiler vectorises where it can. Both use the
+//same functions below, so they give exactly the same numbers.
+//////
+
+#ifndef DERIVEDVARS_H
+#define DERIVEDVARS_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "TreeConnector.h"
+#include "JetMatcher.h"
+using std::vector;
+
+
+/*
+  Delta R between two jets, with the difference in phi wrapped into [0, pi]
+  the same way as JetMatcher does it
+*/
+inline Float_t deltaR(Float_t eta1, Float_t phi1, Float_t eta2, Float_t phi2)
+{
+  const Float_t pi = 3.14159265358979f;
+  Float_t deta = eta1 - eta2;
+  Float_t dphi = std::fabs(phi1 - phi2);
+  dphi = std::min(dphi, 2*pi - dphi);
+  return std::sqrt(deta*deta + dphi*dphi);
+}
+
+
+/*
+  Invariant mass of two jets given as Pt, Eta, Phi, M
+*/
+inline Float_t dijetMass(Float_t pt1, Float_t eta1, Float_t phi1, Float_t m1,
+			 Float_t pt2, Float_t eta2, Float_t phi2, Float_t m2)
+{
+  double px = pt1*std::cos((double)phi1) + pt2*std::cos((double)phi2);
+  double py = pt1*std::sin((double)phi1) + pt2*std::sin((double)phi2);
+  double pz1 = pt1*std::sinh((double)eta1), pz2 = pt2*std::sinh((double)eta2);
+  double e1 = std::sqrt(pz1*pz1 + (double)pt1*pt1 + (double)m1*m1);
+  double e2 = std::sqrt(pz2*pz2 + (double)pt2*pt2 + (double)m2*m2);
+  double pz = pz1 + pz2, e = e1 + e2;
+  double m2sum = e*e - px*px - py*py - pz*pz;
+  return m2sum > 0 ? std::sqrt(m2sum) : 0;
+}
+
+
+static const int nLeading = 2;          //Large jets that the matched small jets are counted for
+
+
+class DerivedVars
+{
+ public:
+  DerivedVars(const TreeConnector &tc, JetMatcher &matcher) : tc(tc), matcher(matcher), have(0) {}
+
+  bool hasPair() const { return tc.ljet_pt->size() >= 2; }
+  Float_t dR12();
+  Float_t mjj();
+  Float_t HT();
+  int nJets() const { return tc.jet_pt->size(); }
+  int nMatched(int i);
+  Float_t matchedPt(int i);
+
+ private:
+  enum { kDR12 = 1, kMjj = 2, kHT = 4, kMatch = 8 };
+
+  void match();
+
+  const TreeConnector &tc;
+  JetMatcher &matcher;          //Kept by the caller so its arrays last between events
+  int have;                     //Which values have been worked out
+  Float_t dR12Value, mjjValue, HTValue;
+  int nMatchedValue[nLeading];
+  Float_t matchedPtValue[nLeading];
+};
+
+
+class DerivedColumns
+{
+ public:
+  DerivedColumns() : batch(0), have(0) {}
+
+  void newBatch(const EventBatch &batch);
+
+  const vector<char> &hasPair();
+  const vector<Float_t> &dR12();
+  const vector<Float_t> &mjj();
+  const vector<Float_t> &HT();
+  const vector<Float_t> &nJets();                             //As Float_t, so it can be histogrammed
+  const vector<Float_t> &leadingPt() { hasPair(); return pt0; }
+  const vector<Float_t> &nMatched(int i) { match(); return nMatchedColumn[i]; }
+  const vector<Float_t> &matchedPt(int i) { match(); return matchedPtColumn[i]; }
+
+ private:
+  enum { kPair = 1, kDR12 = 2, kMjj = 4, kHT = 8, kNJets = 16, kMatch = 32 };
+
+  void match();
+
+  const EventBatch *batch;
+  int have;
+
+  vector<char> pairColumn;
+  vector<Float_t> pt0, eta0, phi0, m0, pt1, eta1, phi1, m1;   //Leading large jets, 0 if there aren't two
+  vector<Float_t> dR12Column, mjjColumn, HTColumn, nJetsColumn;
+  vector<Float_t> nMatchedColumn[nLeading], matchedPtColumn[nLeading];
+  JetMatcher matcher;
+};
+
+
+Float_t DerivedVars::dR12()
+{
+  if (!(have & kDR12))
+    {
+      dR12Value = deltaR(tc.ljet_eta->at(0), tc.ljet_phi->at(0), tc.ljet_eta->at(1), tc.ljet_phi->at(1));
+      have |= kDR12;
+    }
+  return dR12Value;
+}
+
+Float_t DerivedVars::mjj()
+{
+  if (!(have & kMjj))
+    {
+      mjjValue = dijetMass(tc.ljet_pt->at(0), tc.ljet_eta->at(0), tc.ljet_phi->at(0), tc.ljet_m->at(0),
+			   tc.ljet_pt->at(1), tc.ljet_eta->at(1), tc.ljet_phi->at(1), tc.ljet_m->at(1));
+      have |= kMjj;
+    }
+  return mjjValue;
+}
+
+Float_t DerivedVars::HT()
+{
+  if (!(have & kHT))
+    {
+      HTValue = 0;
+      for (size_t j = 0; j < tc.jet_pt->size(); ++j) HTValue += tc.jet_pt->at(j);
+      have |= kHT;
+    }
+  return HTValue;
+}
+
+int DerivedVars::nMatched(int i)
+{
+  match();
+  return nMatchedValue[i];
+}
+
+Float_t DerivedVars::matchedPt(int i)
+{
+  match();
+  return matchedPtValue[i];
+}
+
+/*
+  Matches the small jets to the large jets, and counts the ones of each
+  leading large jet. The small jets are in Pt order, so the first one
+  matched is the leading one.
+*/
+void DerivedVars::match()
+{
+  if (have & kMatch) return;
+
+  int nj = tc.jet_pt->size(), nl = tc.ljet_pt->size();
+  matcher.match(nj ? &tc.jet_eta->at(0) : 0, nj ? &tc.jet_phi->at(0) : 0, nj,
+		nl ? &tc.ljet_eta->at(0) : 0, nl ? &tc.ljet_phi->at(0) : 0, nl);
+
+  for (int i = 0; i < nLeading; ++i) { nMatchedValue[i] = 0; matchedPtValue[i] = 0; }
+  for (int j = 0; j < nj; ++j)
+    {
+      int l = matcher.matched(j);
+      if (l < 0 || l >= nLeading) continue;
+      if (nMatchedValue[l]++ == 0) matchedPtValue[l] = tc.jet_pt->at(j);
+    }
+
+  have |= kMatch;
+}
+
+
+/*
+  Starts on a new batch, forgetting the columns of the last one
+*/
+void DerivedColumns::newBatch(const EventBatch &batch_in)
+{
+  batch = &batch_in;
+  have = 0;
+}
+
+
+/*
+  1 for the events with at least two large jets. Also copies the two
+  leading large jets into their own arrays.
+*/
+const vector<char> &DerivedColumns::hasPair()
+{
+  if (have & kPair) return pairColumn;
+
+  Long64_t n = batch->nEvents;
+  pairColumn.resize(n);
+  vector<Float_t> *leading[8] = { &pt0, &eta0, &phi0, &m0, &pt1, &eta1, &phi1, &m1 };
+  for (int c = 0; c < 8; ++c) leading[c]->assign(n, 0);
+
+  for (Long64_t e = 0; e < n; ++e)
+    {
+      int lj = batch->ljet_offsets[e];
+      pairColumn[e] = (batch->ljet_offsets[e+1] - lj >= 2);
+      if (!pairColumn[e]) continue;
+
+      pt0[e] = batch->ljet_pt[lj];   eta0[e] = batch->ljet_eta[lj];   phi0[e] = batch->ljet_phi[lj];   m0[e] = batch->ljet_m[lj];
+      pt1[e] = batch->ljet_pt[lj+1]; eta1[e] = batch->ljet_eta[lj+1]; phi1[e] = batch->ljet_phi[lj+1]; m1[e] = batch->ljet_m[lj+1];
+    }
+
+  have |= kPair;
+  return pairColumn;
+}
+
+const vector<Float_t> &DerivedColumns::dR12()
+{
+  if (have & kDR12) return dR12Column;
+  hasPair();
+
+  Long64_t n = batch->nEvents;
+  dR12Column.resize(n);
+  for (Long64_t e = 0; e < n; ++e) dR12Column[e] = deltaR(eta0[e], phi0[e], eta1[e], phi1[e]);
+
+  have |= kDR12;
+  return dR12Column;
+}
+
+const vector<Float_t> &DerivedColumns::mjj()
+{
+  if (have & kMjj) return mjjColumn;
+  hasPair();
+
+  Long64_t n = batch->nEvents;
+  mjjColumn.resize(n);
+  for (Long64_t e = 0; e < n; ++e) mjjColumn[e] = dijetMass(pt0[e], eta0[e], phi0[e], m0[e], pt1[e], eta1[e], phi1[e], m1[e]);
+
+  have |= kMjj;
+  return mjjColumn;
+}
+
+const vector<Float_t> &DerivedColumns::HT()
+{
+  if (have & kHT) return HTColumn;
+
+  Long64_t n = batch->nEvents;
+  HTColumn.resize(n);
+  for (Long64_t e = 0; e < n; ++e)
+    {
+      Float_t sum = 0;
+      for (int j = batch->jet_offsets[e]; j < batch->jet_offsets[e+1]; ++j) sum += batch->jet_pt[j];
+      HTColumn[e] = sum;
+    }
+
+  have |= kHT;
+  return HTColumn;
+}
+
+const vector<Float_t> &DerivedColumns::nJets()
+{
+  if (have & kNJets) return nJetsColumn;
+
+  Long64_t n = batch->nEvents;
+  nJetsColumn.resize(n);
+  for (Long64_t e = 0; e < n; ++e) nJetsColumn[e] = batch->jet_offsets[e+1] - batch->jet_offsets[e];
+
+  have |= kNJets;
+  return nJetsColumn;
+}
+
+/*
+  Matches the jets of every event; the jets of one event are already
+  contiguous in the batch
+*/
+void DerivedColumns::match()
+{
+  if (have & kMatch) return;
+
+  Long64_t n = batch->nEvents;
+  for (int i = 0; i < nLeading; ++i) { nMatchedColumn[i].assign(n, 0); matchedPtColumn[i].assign(n, 0); }
+
+  for (Long64_t e = 0; e < n; ++e)
+    {
+      int j0 = batch->jet_offsets[e], nj = batch->jet_offsets[e+1] - j0;
+      int l0 = batch->ljet_offsets[e], nl = batch->ljet_offsets[e+1] - l0;
+      matcher.match(nj ? &batch->jet_eta[j0] : 0, nj ? &batch->jet_phi[j0] : 0, nj,
+		    nl ? &batch->ljet_eta[l0] : 0, nl ? &batch->ljet_phi[l0] : 0, nl);
+
+      for (int j = 0; j < nj; ++j)
+	{
+	  int l = matcher.matched(j);
+	  if (l < 0 || l >= nLeading) continue;
+	  if (nMatchedColumn[l][e]++ == 0) matchedPtColumn[l][e] = batch->jet_pt[j0+j];
+	}
+    }
+
+  have |= kMatch;
+}
+
+
+
+#endif /*DERIVEDVARS_H*/
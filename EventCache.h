@@ -0,0 +1,385 @@
+//////
+//These classes keep the numbers dmcHist fills into its histograms in a
+//small binary file, so the histograms can be made again (with a different
+//number of bins, for example) without reading any of the ntuples.
+//
+//For every event the file holds the combined weight, the number of large
+//and small jets that get filled, and the Pt, Eta, Phi (and Mass) of the
+//leading large jets and small jets, and the quantities of DerivedVars.h
+//(whether there are two large jets, dR12, mjj, HT, the number of small
+//jets, and the small jets matched to each large jet). The events of one
+//range of one input file (see WorkStealer.h) are kept together in a
+//block, with each quantity stored as one contiguous array of floats:
+//
+//  header     magic "DMCEVT03", number of columns, files and blocks, and
+//             where the block table starts
+//  blocks     for every block, nColumns arrays of nEvents floats
+//  table      for every block: sample, file, part, offset, nEvents
+//
+//EventCacheWriter appends blocks in whatever order the threads finish
+//them. EventCacheReader memory maps the file and fills a HistSet from a
+//block, in the same order as the normal event loop does, so histograms
+//made from the cache are bin for bin the same as the ones made from the
+//ntuples.
+//////
+
+#ifndef EVENTCACHE_H
+#define EVENTCACHE_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "TreeConnector.h"
+#include "HistSet.h"
+using std::vector;
+
+
+namespace EventCache
+{
+  //Columns of a block
+  enum Column { kWeight, kNLjet, kNJet,
+		kLjet = 3,                                            //pt, eta, phi, m for every large jet
+		kJet = kLjet + 4*HistSet::n_ljet_hists,               //pt, eta, phi for every small jet
+		kPair = kJet + 3*HistSet::n_jet_hists,                //1 if there are two large jets
+		kDR12, kMjj, kHT, kNJetsAll,                          //Derived quantities
+		kMatch,                                               //Matched small jets and their leading Pt for every large jet
+		kNColumns = kMatch + 2*HistSet::n_ljet_hists };
+
+  struct Header
+  {
+    char magic[8];
+    uint32_t nColumns;
+    uint32_t nFiles;
+    uint64_t nBlocks;
+    uint64_t tableOffset;
+  };
+
+  struct BlockInfo
+  {
+    int32_t sample;
+    int32_t fileNum;
+    int32_t part;
+    int32_t unused;
+    uint64_t offset;          //Where the block's columns start in the file
+    uint64_t nEvents;
+  };
+
+  const char magic[8] = {'D','M','C','E','V','T','0','3'};
+}
+
+
+//The columns of one block while it is being filled
+struct EventCacheBlock
+{
+  vector<float> columns[EventCache::kNColumns];
+  DerivedColumns derived;
+  JetMatcher matcher;
+
+  void clear();
+  void add(TreeConnector &tc, Float_t totalWeight);
+  void add(const EventBatch &batch);
+};
+
+
+class EventCacheWriter
+{
+ public:
+  EventCacheWriter();
+  ~EventCacheWriter();
+
+  bool open(const std::string &path, int nFiles);
+  void write(int sample, int fileNum, int part, const EventCacheBlock &block);
+  bool close();
+
+ private:
+  FILE *file;
+  uint32_t nFiles;
+  uint64_t offset;
+  vector<EventCache::BlockInfo> table;
+  std::mutex lock;
+};
+
+
+class EventCacheReader
+{
+ public:
+  EventCacheReader();
+  ~EventCacheReader();
+
+  bool open(const std::string &path);
+  int nFiles() const { return header->nFiles; }
+  int nBlocks() const { return header->nBlocks; }
+  const EventCache::BlockInfo &block(int b) const { return table[b]; }
+  void fill(int b, HistSet &hists) const;
+
+ private:
+  char *data;                 //The whole memory mapped file
+  size_t size;
+  const EventCache::Header *header;
+  const EventCache::BlockInfo *table;
+};
+
+
+void EventCacheBlock::clear()
+{
+  for (int c = 0; c < EventCache::kNColumns; ++c) columns[c].clear();
+}
+
+/*
+  Adds the event currently loaded in tc
+*/
+void EventCacheBlock::add(TreeConnector &tc, Float_t totalWeight)
+{
+  using namespace EventCache;
+
+  int nl = tc.ljet_pt->size() < (size_t)HistSet::n_ljet_hists ? tc.ljet_pt->size() : HistSet::n_ljet_hists;
+  int nj = tc.jet_pt->size() < (size_t)HistSet::n_jet_hists ? tc.jet_pt->size() : HistSet::n_jet_hists;
+
+  columns[kWeight].push_back(totalWeight);
+  columns[kNLjet].push_back(nl);
+  columns[kNJet].push_back(nj);
+
+  for (int i = 0; i < HistSet::n_ljet_hists; ++i)           //Jets that aren't there are stored as 0 and never used
+    {
+      columns[kLjet+4*i  ].push_back(i < nl ? tc.ljet_pt->at(i)  : 0);
+      columns[kLjet+4*i+1].push_back(i < nl ? tc.ljet_eta->at(i) : 0);
+      columns[kLjet+4*i+2].push_back(i < nl ? tc.ljet_phi->at(i) : 0);
+      columns[kLjet+4*i+3].push_back(i < nl ? tc.ljet_m->at(i)   : 0);
+    }
+  for (int i = 0; i < HistSet::n_jet_hists; ++i)
+    {
+      columns[kJet+3*i  ].push_back(i < nj ? tc.jet_pt->at(i)  : 0);
+      columns[kJet+3*i+1].push_back(i < nj ? tc.jet_eta->at(i) : 0);
+      columns[kJet+3*i+2].push_back(i < nj ? tc.jet_phi->at(i) : 0);
+    }
+
+  DerivedVars derived(tc, matcher);
+  columns[kPair].push_back(derived.hasPair());
+  columns[kDR12].push_back(derived.hasPair() ? derived.dR12() : 0);
+  columns[kMjj].push_back(derived.hasPair() ? derived.mjj() : 0);
+  columns[kHT].push_back(derived.HT());
+  columns[kNJetsAll].push_back(derived.nJets());
+  for (int i = 0; i < HistSet::n_ljet_hists; ++i)
+    {
+      columns[kMatch+2*i  ].push_back(derived.nMatched(i));
+      columns[kMatch+2*i+1].push_back(derived.matchedPt(i));
+    }
+}
+
+/*
+  Adds every event of a batch
+*/
+void EventCacheBlock::add(const EventBatch &batch)
+{
+  using namespace EventCache;
+
+  derived.newBatch(batch);
+  const vector<char> &pair = derived.hasPair();
+  const vector<Float_t> &dR12 = derived.dR12(), &mjj = derived.mjj(), &HT = derived.HT(), &nJets = derived.nJets();
+
+  for (Long64_t e = 0; e < batch.nEvents; ++e)
+    {
+      int lj = batch.ljet_offsets[e], j = batch.jet_offsets[e];
+      int nl = batch.ljet_offsets[e+1] - lj, nj = batch.jet_offsets[e+1] - j;
+      if (nl > HistSet::n_ljet_hists) nl = HistSet::n_ljet_hists;
+      if (nj > HistSet::n_jet_hists) nj = HistSet::n_jet_hists;
+
+      columns[kWeight].push_back(batch.weight[e]);
+      columns[kNLjet].push_back(nl);
+      columns[kNJet].push_back(nj);
+
+      for (int i = 0; i < HistSet::n_ljet_hists; ++i)
+	{
+	  columns[kLjet+4*i  ].push_back(i < nl ? batch.ljet_pt[lj+i]  : 0);
+	  columns[kLjet+4*i+1].push_back(i < nl ? batch.ljet_eta[lj+i] : 0);
+	  columns[kLjet+4*i+2].push_back(i < nl ? batch.ljet_phi[lj+i] : 0);
+	  columns[kLjet+4*i+3].push_back(i < nl ? batch.ljet_m[lj+i]   : 0);
+	}
+      for (int i = 0; i < HistSet::n_jet_hists; ++i)
+	{
+	  columns[kJet+3*i  ].push_back(i < nj ? batch.jet_pt[j+i]  : 0);
+	  columns[kJet+3*i+1].push_back(i < nj ? batch.jet_eta[j+i] : 0);
+	  columns[kJet+3*i+2].push_back(i < nj ? batch.jet_phi[j+i] : 0);
+	}
+
+      columns[kPair].push_back(pair[e]);
+      columns[kDR12].push_back(pair[e] ? dR12[e] : 0);
+      columns[kMjj].push_back(pair[e] ? mjj[e] : 0);
+      columns[kHT].push_back(HT[e]);
+      columns[kNJetsAll].push_back(nJets[e]);
+      for (int i = 0; i < HistSet::n_ljet_hists; ++i)
+	{
+	  columns[kMatch+2*i  ].push_back(derived.nMatched(i)[e]);
+	  columns[kMatch+2*i+1].push_back(derived.matchedPt(i)[e]);
+	}
+    }
+}
+
+
+EventCacheWriter::EventCacheWriter() : file(0), nFiles(0), offset(0) {}
+
+EventCacheWriter::~EventCacheWriter() { if (file) fclose(file); }
+
+/*
+  Starts a new cache file. The header is written again by close().
+*/
+bool EventCacheWriter::open(const std::string &path, int nFiles_in)
+{
+  file = fopen(path.c_str(), "wb");
+  if (!file) { std::cout << path << " could not be opened for writing!" << std::endl; return false; }
+
+  nFiles = nFiles_in;
+  table.clear();
+
+  EventCache::Header header;
+  memset(&header, 0, sizeof(header));
+  fwrite(&header, sizeof(header), 1, file);
+  offset = sizeof(header);
+  return true;
+}
+
+/*
+  Appends one block, can be called from any thread
+*/
+void EventCacheWriter::write(int sample, int fileNum, int part, const EventCacheBlock &block)
+{
+  using namespace EventCache;
+  std::lock_guard<std::mutex> guard(lock);
+
+  BlockInfo info;
+  info.sample = sample;
+  info.fileNum = fileNum;
+  info.part = part;
+  info.unused = 0;
+  info.offset = offset;
+  info.nEvents = block.columns[kWeight].size();
+
+  if (info.nEvents > 0)
+    for (int c = 0; c < kNColumns; ++c)
+      fwrite(&block.columns[c][0], sizeof(float), info.nEvents, file);
+
+  offset += kNColumns * sizeof(float) * info.nEvents;
+  table.push_back(info);
+}
+
+/*
+  Writes the block table and the header
+*/
+bool EventCacheWriter::close()
+{
+  if (!file) return false;
+
+  EventCache::Header header;
+  memcpy(header.magic, EventCache::magic, sizeof(header.magic));
+  header.nColumns = EventCache::kNColumns;
+  header.nFiles = nFiles;
+  header.nBlocks = table.size();
+  header.tableOffset = offset;
+
+  if (!table.empty()) fwrite(&table[0], sizeof(EventCache::BlockInfo), table.size(), file);
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+
+  bool ok = (ferror(file) == 0);
+  fclose(file);
+  file = 0;
+  return ok;
+}
+
+
+EventCacheReader::EventCacheReader() : data(0), size(0), header(0), table(0) {}
+
+EventCacheReader::~EventCacheReader() { if (data) munmap(data, size); }
+
+/*
+  Memory maps a cache file and checks that it is complete
+*/
+bool EventCacheReader::open(const std::string &path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) { std::cout << path << " could not be opened!" << std::endl; return false; }
+
+  struct stat st;
+  fstat(fd, &st);
+  size = st.st_size;
+
+  if (size >= sizeof(EventCache::Header))
+    {
+      void *p = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) data = (char*)p;
+    }
+  ::close(fd);
+
+  header = (const EventCache::Header*)data;
+  if (!data || memcmp(header->magic, EventCache::magic, sizeof(header->magic)) != 0
+      || header->nColumns != (uint32_t)EventCache::kNColumns
+      || header->tableOffset + header->nBlocks*sizeof(EventCache::BlockInfo) > size)
+    {
+      std::cout << path << " is not a complete event cache for this version of dmcHist!" << std::endl;
+      return false;
+    }
+
+  table = (const EventCache::BlockInfo*)(data + header->tableOffset);
+  madvise(data, size, MADV_SEQUENTIAL);
+  return true;
+}
+
+/*
+  Fills hists from every event of block b, the same way HistSet::fill does
+*/
+void EventCacheReader::fill(int b, HistSet &hists) const
+{
+  using namespace EventCache;
+
+  const BlockInfo &info = table[b];
+  const float *col[kNColumns];
+  for (int c = 0; c < kNColumns; ++c) col[c] = (const float*)(data + info.offset) + c*info.nEvents;
+
+  for (uint64_t e = 0; e < info.nEvents; ++e)
+    {
+      Float_t totalWeight = col[kWeight][e];
+      int nl = (int)col[kNLjet][e];
+      int nj = (int)col[kNJet][e];
+
+      for (int i = 0; i < nl; ++i)
+	{
+	  hists.h_ljet_pt[i]->Fill(col[kLjet+4*i][e],    totalWeight);
+	  hists.h_ljet_eta[i]->Fill(col[kLjet+4*i+1][e], totalWeight);
+	  hists.h_ljet_phi[i]->Fill(col[kLjet+4*i+2][e], totalWeight);
+	  hists.h_ljet_m[i]->Fill(col[kLjet+4*i+3][e],   totalWeight);
+	}
+      for (int i = 0; i < nj; ++i)
+	{
+	  hists.h_jet_pt[i]->Fill(col[kJet+3*i][e],    totalWeight);
+	  hists.h_jet_eta[i]->Fill(col[kJet+3*i+1][e], totalWeight);
+	  hists.h_jet_phi[i]->Fill(col[kJet+3*i+2][e], totalWeight);
+	}
+
+      if (col[kPair][e])
+	{
+	  hists.h_ljet_dR12->Fill(col[kDR12][e], totalWeight);
+	  hists.h_ljet_mjj->Fill(col[kMjj][e],   totalWeight);
+	  hists.h_ljet_pt0_FLAG[HistSet::dR12Section(col[kDR12][e])]->Fill(col[kLjet][e], totalWeight);
+	}
+      hists.h_jet_HT->Fill(col[kHT][e],        totalWeight);
+      hists.h_jet_n->Fill(col[kNJetsAll][e],   totalWeight);
+
+      for (int i = 0; i < nl; ++i)
+	{
+	  hists.h_ljet_nmatch[i]->Fill(col[kMatch+2*i][e], totalWeight);
+	  if (col[kMatch+2*i][e] > 0) hists.h_ljet_matchpt[i]->Fill(col[kMatch+2*i+1][e], totalWeight);
+	}
+    }
+}
+
+
+
+#endif /*EVENTCACHE_H*/
@@ -0,0 +1,448 @@
+//////
+//These classes select events with cuts written as expressions, e.g.
+//
+//  ljet_pt[0] > 300e3 && jet_pt.size() >= 3
+//  abs(ljet_eta[0] - ljet_eta[1]) < 1.3
+//
+//CutExpression parses an expression once into a tree of nodes that reads
+//the TreeConnector variables directly. It knows the branches TreeConnector
+//connects: the weights (weight_mc, ...) and the jet_* and ljet_* vectors,
+//which can be indexed (an index past the end gives NaN, so every
+//comparison with it is false) or counted with .size(). The operators are
+//|| && ! == != < <= > >= + - * / and abs().
+//
+//EventSelection applies a list of cuts in order, one after the other (the
+//cutflow). For every event it reads only the branches the first cut needs,
+//then the new branches of the next cut if it passed, and so on; the rest
+//of the branches TreeConnector reads are only loaded for events that pass
+//every cut. With a tight selection most baskets are never decompressed.
+//It counts the events passing each cut and the time spent on each.
+//////
+
+#ifndef EVENTSELECTION_H
+#define EVENTSELECTION_H
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include <stdexcept>
+#include <chrono>
+#include "TTree.h"
+#include "TBranch.h"
+#include "TreeConnector.h"
+using std::vector;
+
+
+class CutExpression
+{
+ public:
+  CutExpression(const std::string &text);
+
+  double eval(const TreeConnector &tc) const { return root->eval(tc); }
+  bool pass(const TreeConnector &tc) const { return root->eval(tc) != 0; }
+
+  std::string text;
+  vector<std::string> branches;   //Branches the expression reads
+
+ private:
+  enum Op { kNumber, kScalar, kElement, kSize, kNot, kNeg, kAbs,
+	    kOr, kAnd, kEq, kNe, kLt, kLe, kGt, kGe, kAdd, kSub, kMul, kDiv };
+
+  struct Node
+  {
+    Op op;
+    double value;
+    Float_t TreeConnector::*scalar;
+    vector<float>* TreeConnector::*vec;
+    std::shared_ptr<Node> a, b;
+
+    double eval(const TreeConnector &tc) const;
+  };
+  typedef std::shared_ptr<Node> NodePtr;
+
+  NodePtr parseOr();
+  NodePtr parseAnd();
+  NodePtr parseCompare();
+  NodePtr parseSum();
+  NodePtr parseProduct();
+  NodePtr parseUnary();
+  NodePtr parsePrimary();
+  NodePtr variable(const std::string &name);
+
+  NodePtr make(Op op, NodePtr a = NodePtr(), NodePtr b = NodePtr());
+  bool accept(const char *token);
+  void expect(const char *token);
+  void fail(const std::string &why);
+  void skipSpaces();
+
+  NodePtr root;
+  size_t pos;                     //Where the parser is in text
+};
+
+
+class EventSelection
+{
+ public:
+  EventSelection(const vector<std::string> &cuts);
+
+  void connect(TreeConnector &tc);
+  bool select(Long64_t entry);
+  void add(const EventSelection &other);
+  void report();
+
+ private:
+  vector<CutExpression> cuts;
+  TreeConnector *tc;
+  vector<vector<TBranch*> > stepBranches;  //Branches first needed by each cut
+  vector<TBranch*> rest;                   //Branches only needed to fill the histograms
+
+  Long64_t nEvents;
+  vector<Long64_t> passed;
+  vector<double> seconds;
+  double restSeconds;
+};
+
+
+/*
+  Parses text, throwing std::invalid_argument if it isn't a valid cut
+*/
+CutExpression::CutExpression(const std::string &text_in) : text(text_in), pos(0)
+{
+  root = parseOr();
+  skipSpaces();
+  if (pos != text.size()) fail("unexpected \"" + text.substr(pos) + "\"");
+}
+
+
+double CutExpression::Node::eval(const TreeConnector &tc) const
+{
+  switch (op)
+    {
+    case kNumber:  return value;
+    case kScalar:  return tc.*scalar;
+    case kElement:
+      {
+	double i = a->eval(tc);
+	const vector<float> *v = tc.*vec;
+	if (!(i >= 0) || i >= v->size()) return NAN;
+	return (*v)[(size_t)i];
+      }
+    case kSize:    return (tc.*vec)->size();
+    case kNot:     return !(a->eval(tc) != 0);
+    case kNeg:     return -a->eval(tc);
+    case kAbs:     return std::fabs(a->eval(tc));
+    case kOr:      return a->eval(tc) != 0 || b->eval(tc) != 0;
+    case kAnd:     return a->eval(tc) != 0 && b->eval(tc) != 0;
+    case kEq:      return a->eval(tc) == b->eval(tc);
+    case kNe:      return a->eval(tc) != b->eval(tc);
+    case kLt:      return a->eval(tc) <  b->eval(tc);
+    case kLe:      return a->eval(tc) <= b->eval(tc);
+    case kGt:      return a->eval(tc) >  b->eval(tc);
+    case kGe:      return a->eval(tc) >= b->eval(tc);
+    case kAdd:     return a->eval(tc) + b->eval(tc);
+    case kSub:     return a->eval(tc) - b->eval(tc);
+    case kMul:     return a->eval(tc) * b->eval(tc);
+    case kDiv:     return a->eval(tc) / b->eval(tc);
+    }
+  return 0;
+}
+
+
+CutExpression::NodePtr CutExpression::parseOr()
+{
+  NodePtr n = parseAnd();
+  while (accept("||")) n = make(kOr, n, parseAnd());
+  return n;
+}
+
+CutExpression::NodePtr CutExpression::parseAnd()
+{
+  NodePtr n = parseCompare();
+  while (accept("&&")) n = make(kAnd, n, parseCompare());
+  return n;
+}
+
+CutExpression::NodePtr CutExpression::parseCompare()
+{
+  NodePtr n = parseSum();
+  if (accept("==")) return make(kEq, n, parseSum());
+  if (accept("!=")) return make(kNe, n, parseSum());
+  if (accept("<=")) return make(kLe, n, parseSum());
+  if (accept(">=")) return make(kGe, n, parseSum());
+  if (accept("<"))  return make(kLt, n, parseSum());
+  if (accept(">"))  return make(kGt, n, parseSum());
+  return n;
+}
+
+CutExpression::NodePtr CutExpression::parseSum()
+{
+  NodePtr n = parseProduct();
+  while (true)
+    {
+      if (accept("+")) n = make(kAdd, n, parseProduct());
+      else if (accept("-")) n = make(kSub, n, parseProduct());
+      else return n;
+    }
+}
+
+CutExpression::NodePtr CutExpression::parseProduct()
+{
+  NodePtr n = parseUnary();
+  while (true)
+    {
+      if (accept("*")) n = make(kMul, n, parseUnary());
+      else if (accept("/")) n = make(kDiv, n, parseUnary());
+      else return n;
+    }
+}
+
+CutExpression::NodePtr CutExpression::parseUnary()
+{
+  if (accept("!")) return make(kNot, parseUnary());
+  if (accept("-")) return make(kNeg, parseUnary());
+  return parsePrimary();
+}
+
+CutExpression::NodePtr CutExpression::parsePrimary()
+{
+  skipSpaces();
+  if (pos >= text.size()) fail("unexpected end");
+
+  if (accept("("))
+    {
+      NodePtr n = parseOr();
+      expect(")");
+      return n;
+    }
+
+  if (isdigit(text[pos]) || text[pos] == '.')
+    {
+      const char *start = text.c_str() + pos;
+      char *end;
+      NodePtr n = make(kNumber);
+      n->value = strtod(start, &end);
+      pos += end - start;
+      return n;
+    }
+
+  size_t start = pos;
+  while (pos < text.size() && (isalnum(text[pos]) || text[pos] == '_')) ++pos;
+  std::string name = text.substr(start, pos - start);
+  if (name.empty()) fail("unexpected \"" + text.substr(pos) + "\"");
+
+  if (name == "abs")
+    {
+      expect("(");
+      NodePtr n = make(kAbs, parseOr());
+      expect(")");
+      return n;
+    }
+
+  NodePtr n = variable(name);
+  if (n->op == kScalar) return n;
+
+  if (accept("["))
+    {
+      n->op = kElement;
+      n->a = parseOr();
+      expect("]");
+    }
+  else if (accept(".size"))
+    {
+      expect("(");
+      expect(")");
+      n->op = kSize;
+    }
+  else fail(name + " needs [index] or .size()");
+
+  return n;
+}
+
+
+/*
+  Node reading a TreeConnector variable, and notes its branch
+*/
+CutExpression::NodePtr CutExpression::variable(const std::string &name)
+{
+  struct Scalar { const char *name; Float_t TreeConnector::*member; };
+  struct Vector { const char *name; vector<float>* TreeConnector::*member; };
+
+  static const Scalar scalars[] = {
+    { "weight_mc", &TreeConnector::weight_mc }, { "weight_pileup", &TreeConnector::weight_pileup },
+    { "weight_leptonSF", &TreeConnector::weight_leptonSF }, { "weight_jvt", &TreeConnector::weight_jvt } };
+  static const Vector vectors[] = {
+    { "jet_pt", &TreeConnector::jet_pt }, { "jet_eta", &TreeConnector::jet_eta }, { "jet_phi", &TreeConnector::jet_phi },
+    { "ljet_pt", &TreeConnector::ljet_pt }, { "ljet_eta", &TreeConnector::ljet_eta },
+    { "ljet_phi", &TreeConnector::ljet_phi }, { "ljet_m", &TreeConnector::ljet_m } };
+
+  NodePtr n;
+  for (size_t i = 0; i < sizeof(scalars)/sizeof(scalars[0]) && !n; ++i)
+    if (name == scalars[i].name) { n = make(kScalar); n->scalar = scalars[i].member; }
+  for (size_t i = 0; i < sizeof(vectors)/sizeof(vectors[0]) && !n; ++i)
+    if (name == vectors[i].name) { n = make(kSize); n->vec = vectors[i].member; }
+  if (!n) fail("unknown variable " + name);
+
+  bool known = false;
+  for (size_t i = 0; i < branches.size(); ++i) known = known || branches[i] == name;
+  if (!known) branches.push_back(name);
+
+  return n;
+}
+
+
+CutExpression::NodePtr CutExpression::make(Op op, NodePtr a, NodePtr b)
+{
+  NodePtr n(new Node);
+  n->op = op;
+  n->value = 0;
+  n->scalar = 0;
+  n->vec = 0;
+  n->a = a;
+  n->b = b;
+  return n;
+}
+
+bool CutExpression::accept(const char *token)
+{
+  skipSpaces();
+  size_t len = strlen(token);
+  if (text.compare(pos, len, token) != 0) return false;
+  if (len == 1 && pos+1 < text.size() && (token[0] == '<' || token[0] == '>' || token[0] == '!') && text[pos+1] == '=') return false;
+  pos += len;
+  return true;
+}
+
+void CutExpression::expect(const char *token)
+{
+  if (!accept(token)) fail(std::string("expected \"") + token + "\"");
+}
+
+void CutExpression::fail(const std::string &why)
+{
+  std::stringstream ss;
+  ss << "Cut \"" << text << "\": " << why << " at character " << pos+1;
+  throw std::invalid_argument(ss.str());
+}
+
+void CutExpression::skipSpaces()
+{
+  while (pos < text.size() && isspace(text[pos])) ++pos;
+}
+
+
+/*
+  Parses every cut (throws std::invalid_argument if one isn't valid)
+*/
+EventSelection::EventSelection(const vector<std::string> &cutTexts)
+  : tc(0), nEvents(0), passed(cutTexts.size(), 0), seconds(cutTexts.size(), 0), restSeconds(0)
+{
+  for (size_t c = 0; c < cutTexts.size(); ++c) cuts.push_back(CutExpression(cutTexts[c]));
+}
+
+
+/*
+  Finds the branches of each cut in the tree tc was just connected to.
+  Throws std::invalid_argument if a cut needs a branch tc doesn't read (the
+  weights of data).
+*/
+void EventSelection::connect(TreeConnector &tc_in)
+{
+  tc = &tc_in;
+  stepBranches.assign(cuts.size(), vector<TBranch*>());
+  rest.clear();
+
+  vector<TString> used;
+  for (size_t c = 0; c < cuts.size(); ++c)
+    for (size_t b = 0; b < cuts[c].branches.size(); ++b)
+      {
+	TString name(cuts[c].branches[b].c_str());
+	bool read = false, seen = false;
+	for (size_t r = 0; r < tc->branchesRead.size(); ++r) read = read || tc->branchesRead[r] == name;
+	for (size_t u = 0; u < used.size(); ++u) seen = seen || used[u] == name;
+	if (!read) throw std::invalid_argument(std::string("Cut \"") + cuts[c].text + "\" uses " + name.Data() + ", which isn't read for this file");
+	if (seen) continue;
+
+	used.push_back(name);
+	stepBranches[c].push_back(tc->cTree->GetBranch(name));
+      }
+
+  for (size_t r = 0; r < tc->branchesRead.size(); ++r)
+    {
+      bool seen = false;
+      for (size_t u = 0; u < used.size(); ++u) seen = seen || used[u] == tc->branchesRead[r];
+      if (!seen) rest.push_back(tc->cTree->GetBranch(tc->branchesRead[r]));
+    }
+}
+
+
+/*
+  Loads entry one cut at a time and returns true if it passes all of them,
+  with every branch loaded
+*/
+bool EventSelection::select(Long64_t entry)
+{
+  ++nEvents;
+
+  for (size_t c = 0; c < cuts.size(); ++c)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (size_t b = 0; b < stepBranches[c].size(); ++b) stepBranches[c][b]->GetEntry(entry);
+      bool ok = cuts[c].pass(*tc);
+      seconds[c] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      if (!ok) return false;
+      ++passed[c];
+    }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t b = 0; b < rest.size(); ++b) rest[b]->GetEntry(entry);
+  restSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  return true;
+}
+
+
+/*
+  Adds the counts and times of another thread's selection
+*/
+void EventSelection::add(const EventSelection &other)
+{
+  nEvents += other.nEvents;
+  for (size_t c = 0; c < cuts.size(); ++c) { passed[c] += other.passed[c]; seconds[c] += other.seconds[c]; }
+  restSeconds += other.restSeconds;
+}
+
+
+/*
+  Prints the cutflow
+*/
+void EventSelection::report()
+{
+  std::cout << "Cutflow:" << std::endl
+	    << "      events  of previous   time (s)  cut" << std::endl
+	    << std::setw(12) << nEvents << std::setw(13) << "" << std::setw(11) << "" << "  all events" << std::endl;
+
+  Long64_t before = nEvents;
+  for (size_t c = 0; c < cuts.size(); ++c)
+    {
+      std::cout << std::setw(12) << passed[c] << std::fixed << std::setprecision(1)
+		<< std::setw(12) << (before > 0 ? 100.0*passed[c]/before : 0) << "%"
+		<< std::setprecision(3) << std::setw(11) << seconds[c] << "  " << cuts[c].text << std::endl;
+      before = passed[c];
+    }
+  std::cout << std::setw(36) << restSeconds << "  loading the other branches of passing events" << std::endl;
+
+  std::cout.unsetf(std::ios::fixed);
+  std::cout << std::setprecision(6);
+}
+
+
+
+#endif /*EVENTSELECTION_H*/
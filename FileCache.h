@@ -0,0 +1,201 @@
+//////
+//This class keeps local copies of the input files in a scratch directory,
+//so running dmcHist again on the same file list doesn't pull every file
+//over the network again. The first time a file is used it is copied into
+//the cache directory, under a name made from its path, size and
+//modification time (so a file that changed gets a new copy). After that
+//the local copy is opened instead.
+//
+//The modification time of a copy is updated every time it is used, and
+//when the cache grows past its byte budget the copies that were used
+//longest ago are deleted first. Everything the cache needs to know is in
+//the directory itself, so it works across runs and several dmcHist jobs
+//can share one cache directory.
+//////
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <ctime>
+#include <functional>
+#include <unistd.h>
+#include "TSystem.h"
+#include "TFile.h"
+#include "TString.h"
+using std::vector;
+
+
+class FileCache
+{
+ public:
+  FileCache(const TString &dir, Long64_t budget);
+
+  TString localPath(const TString &path, bool &hit);
+  void report();
+
+ private:
+  struct Entry
+  {
+    TString path;
+    Long64_t size;
+    Long_t mtime;
+  };
+
+  TString cacheName(const TString &path, const FileStat_t &stat);
+  void evict(const TString &keep);
+
+  TString dir;
+  Long64_t budget;            //Bytes the cache directory may hold
+
+  int hits, misses, failures;
+  Long64_t bytesCopied;
+
+  std::mutex lock;
+  std::condition_variable copied;
+  std::set<std::string> copying;   //Copies that are being made by this process right now
+};
+
+
+FileCache::FileCache(const TString &dir_in, Long64_t budget_in)
+  : dir(dir_in), budget(budget_in), hits(0), misses(0), failures(0), bytesCopied(0)
+{
+  gSystem->mkdir(dir, kTRUE);
+}
+
+
+/*
+  Returns the path of the local copy of a file, making the copy first if
+  there isn't one. If the file can't be copied, its own path is returned.
+  hit says if the copy was already there.
+*/
+TString FileCache::localPath(const TString &path, bool &hit)
+{
+  hit = false;
+
+  FileStat_t stat;
+  if (gSystem->GetPathInfo(path, stat) != 0) return path;   //Let the caller deal with missing files
+
+  TString local = cacheName(path, stat);
+  std::string key(local.Data());
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    copied.wait(guard, [&]{ return copying.count(key) == 0; });   //Another thread is copying this file
+
+    if (!gSystem->AccessPathName(local))
+      {
+	++hits;
+	hit = true;
+	gSystem->Utime(local, time(0), 0);                    //Mark it as just used
+	return local;
+      }
+    copying.insert(key);
+  }
+
+  //Copy under a temporary name and rename it when done, so nobody ever
+  //opens a half copied file (the rename is atomic in the same directory)
+  std::stringstream tmp;
+  tmp << local << ".part" << getpid() << "_" << std::hash<std::thread::id>()(std::this_thread::get_id());
+  bool ok = TFile::Cp(path, tmp.str().c_str(), kFALSE) && gSystem->Rename(tmp.str().c_str(), local) == 0;
+  if (!ok) gSystem->Unlink(tmp.str().c_str());
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    copying.erase(key);
+    if (ok) { ++misses; bytesCopied += stat.fSize; }
+    else ++failures;
+  }
+  copied.notify_all();
+
+  if (!ok) return path;
+
+  evict(local);
+  return local;
+}
+
+
+/*
+  Name of the copy: the file's own name, prefixed by a hash of its full
+  path, size and modification time
+*/
+TString FileCache::cacheName(const TString &path, const FileStat_t &stat)
+{
+  std::stringstream key, name;
+  key << path << "|" << stat.fSize << "|" << stat.fMtime;
+  name << dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+       << std::hash<std::string>()(key.str()) << "_" << gSystem->BaseName(path);
+  return TString(name.str());
+}
+
+
+/*
+  Deletes the least recently used copies until the cache fits in its
+  budget. The copy that was just made (keep) is never deleted.
+*/
+void FileCache::evict(const TString &keep)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  vector<Entry> entries;
+  Long64_t total = 0;
+
+  void *dirp = gSystem->OpenDirectory(dir);
+  if (!dirp) return;
+
+  const char *name;
+  while ((name = gSystem->GetDirEntry(dirp)))
+    {
+      TString file(name);
+      if (file == "." || file == ".." || file.Contains(".part")) continue;
+
+      Entry e;
+      e.path = dir + "/" + file;
+      FileStat_t stat;
+      if (gSystem->GetPathInfo(e.path, stat) != 0) continue;
+      e.size = stat.fSize;
+      e.mtime = stat.fMtime;
+      total += e.size;
+      entries.push_back(e);
+    }
+  gSystem->FreeDirectory(dirp);
+
+  if (total <= budget) return;
+
+  std::multimap<Long_t, int> byAge;                       //Oldest first
+  for (int i = 0; i < (int)entries.size(); ++i) byAge.insert(std::make_pair(entries[i].mtime, i));
+
+  for (std::multimap<Long_t, int>::iterator it = byAge.begin(); it != byAge.end() && total > budget; ++it)
+    {
+      Entry &e = entries[it->second];
+      if (e.path == keep) continue;
+      if (gSystem->Unlink(e.path) == 0) total -= e.size;
+    }
+}
+
+
+/*
+  Prints how many files came from the cache
+*/
+void FileCache::report()
+{
+  std::cout << "File cache (" << dir << "): "
+	    << hits << " hits, " << misses << " misses";
+  if (failures > 0) std::cout << ", " << failures << " could not be copied";
+  std::cout << ", " << std::fixed << std::setprecision(1) << bytesCopied/1e6 << " MB copied" << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+  std::cout << std::setprecision(6);
+}
+
+
+
+#endif /*FILECACHE_H*/
@@ -0,0 +1,160 @@
+//////
+//This class opens input files ahead of time. Opening a file on /eos/ means
+//checking it exists, opening it, and reading its list of keys and the
+//tree header, which can take hundreds of milliseconds each. Background
+//threads open the files in the order of the text file (or in the order
+//given to the constructor, e.g. a work plan's) and keep up to
+//"depth" of them open and waiting, so that when a dmcHist worker asks for
+//a file with take() it is usually already there.
+//
+//A file that no background thread has started on yet is opened by the
+//worker that asks for it, so take() never waits for files out of order.
+//The actual opening is done by the function passed to the constructor,
+//which returns 0 when the file is ready, 1 when it is empty and should be
+//skipped, 2 when it couldn't be opened this time and is left out, and -1
+//on errors (the same as dmcHist's openFile). The pipeline doesn't look at
+//the code: take() hands it back as it was, and the worker decides.
+//////
+
+#ifndef FILEPIPELINE_H
+#define FILEPIPELINE_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include "TFile.h"
+#include "TTree.h"
+using std::vector;
+
+
+class FilePipeline
+{
+ public:
+  typedef std::function<int(int fileNum, TFile *&f, TTree *&tree)> Opener;
+
+  FilePipeline(int nFiles, int depth, Opener open, const vector<int> &order = vector<int>());
+  ~FilePipeline();
+
+  int take(int fileNum, TFile *&f, TTree *&tree);
+
+ private:
+  enum State { kWaiting, kOpening, kReady, kTaken };
+
+  struct Slot
+  {
+    State state;
+    int status;               //What the opener returned
+    TFile *f;
+    TTree *tree;
+  };
+
+  void run();
+
+  vector<Slot> slots;
+  int depth;                  //Most files open and not taken yet
+  int inFlight;               //Files being opened or waiting to be taken
+  vector<int> order;           //Files in the order they are opened
+  int nextToOpen;             //Position in order
+  bool stopping;
+  Opener open;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  vector<std::thread> threads;
+};
+
+
+/*
+  Opens the files listed in order ahead of time, or all of them in the
+  order of the text file if it is empty
+*/
+FilePipeline::FilePipeline(int nFiles, int depth_in, Opener open_in, const vector<int> &order_in)
+  : slots(nFiles), depth(depth_in), inFlight(0), order(order_in), nextToOpen(0), stopping(false), open(open_in)
+{
+  for (int i = 0; i < nFiles; ++i) { slots[i].state = kWaiting; slots[i].status = 0; slots[i].f = 0; slots[i].tree = 0; }
+  if (order.empty())
+    for (int i = 0; i < nFiles; ++i) order.push_back(i);
+
+  for (int t = 0; t < depth; ++t) threads.push_back(std::thread(&FilePipeline::run, this));
+}
+
+FilePipeline::~FilePipeline()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  changed.notify_all();
+  for (int t = 0; t < (int)threads.size(); ++t) threads[t].join();
+
+  for (int i = 0; i < (int)slots.size(); ++i)        //Files nobody took (the run was aborted)
+    if (slots[i].state == kReady) delete slots[i].f;
+}
+
+
+/*
+  Hands over file fileNum, waiting for it if it is being opened, or opening
+  it right here if nobody has started on it
+*/
+int FilePipeline::take(int fileNum, TFile *&f, TTree *&tree)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  Slot &slot = slots[fileNum];
+
+  if (slot.state == kWaiting)
+    {
+      slot.state = kTaken;
+      guard.unlock();
+      return open(fileNum, f, tree);
+    }
+
+  changed.wait(guard, [&]{ return slot.state == kReady; });
+
+  f = slot.f;
+  tree = slot.tree;
+  slot.state = kTaken;
+  --inFlight;
+  changed.notify_all();                 //There is room for another file
+
+  return slot.status;
+}
+
+
+/*
+  Background thread: opens the next file in order whenever there is room
+*/
+void FilePipeline::run()
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (true)
+    {
+      changed.wait(guard, [&]{ return stopping || nextToOpen >= (int)order.size() || inFlight < depth; });
+      if (stopping) return;
+
+      while (nextToOpen < (int)order.size() && slots[order[nextToOpen]].state != kWaiting) ++nextToOpen;   //Already taken by a worker
+      if (nextToOpen >= (int)order.size()) return;
+
+      int i = order[nextToOpen++];
+      slots[i].state = kOpening;
+      ++inFlight;
+
+      guard.unlock();
+      TFile *f = 0;
+      TTree *tree = 0;
+      int status = open(i, f, tree);
+      guard.lock();
+
+      slots[i].status = status;
+      slots[i].f = f;
+      slots[i].tree = tree;
+      slots[i].state = kReady;
+      changed.notify_all();
+    }
+}
+
+
+
+#endif /*FILEPIPELINE_H*/
@@ -0,0 +1,231 @@
+//////
+//These are the pre-scan and the work plan of dmcHist. Before any
+//histogram is filled, scanFiles() opens every input file with a pool of
+//threads (opening files on /eos/ mostly waits on the network, so many
+//can be opened at once) and notes for each whether it can be read, how
+//many entries its nominal tree has, and the compressed size of the
+//branches that will be read, which is what the file will cost to fill.
+//
+//Files that are missing, can't be opened, or have no nominal tree are
+//listed by reportBadFiles() and left out of the run instead of stopping
+//it, and files that are empty are skipped without being opened again.
+//
+//WorkPlan hands the good files out to the workers by cost: the most
+//expensive file goes first, always to the worker with the least work so
+//far (the files are also opened in that order). The big files are then
+//started early and the small ones fill in the gaps at the end; the
+//WorkStealer evens out whatever is left.
+//////
+
+#ifndef FILEPLAN_H
+#define FILEPLAN_H
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "TSystem.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TString.h"
+#include "TreeConnector.h"
+using std::vector;
+
+
+struct FileInfo
+{
+  enum Status { kGood, kEmpty, kMissing, kUnreadable, kNoTree };
+
+  Status status;
+  Long64_t entries;
+  Long64_t fileBytes;           //Size of the file
+  Long64_t cost;                //Compressed bytes of the branches that are read
+  double openSeconds;
+};
+
+
+class WorkPlan
+{
+ public:
+  WorkPlan(const vector<FileInfo> &info, const vector<int> &files, int nWorkers);
+
+  const vector<int> &order() const { return fileOrder; }            //Files from most to least expensive
+  int worker(int fileNum) const { return assigned[fileNum]; }
+  void report() const;
+  bool write(const std::string &path, const vector<TString> &paths) const;
+
+ private:
+  const vector<FileInfo> &info;
+  vector<int> fileOrder;
+  vector<int> assigned;         //Worker of every file (-1 if it isn't in the plan)
+  vector<Long64_t> load;        //Cost given to every worker
+};
+
+
+const char *statusName(FileInfo::Status status)
+{
+  switch (status)
+    {
+    case FileInfo::kGood:       return "good";
+    case FileInfo::kEmpty:      return "empty";
+    case FileInfo::kMissing:    return "missing";
+    case FileInfo::kUnreadable: return "unreadable";
+    case FileInfo::kNoTree:     return "no nominal tree";
+    }
+  return "";
+}
+
+
+/*
+  Opens one input file and fills in its info. delayMs adds a fake latency,
+  like dmcHist's --open-delay.
+*/
+void scanFile(const TString &path, bool isData, int delayMs, FileInfo &info)
+{
+  info.entries = 0; info.fileBytes = 0; info.cost = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  if (gSystem->AccessPathName(path)) { info.status = FileInfo::kMissing; info.openSeconds = 0; return; }
+  if (delayMs > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+
+  TFile *f = TFile::Open(path, "READ");
+  info.openSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (!f || f->IsZombie()) { delete f; info.status = FileInfo::kUnreadable; return; }
+  info.fileBytes = f->GetSize();
+  if (info.fileBytes < 1) { delete f; info.status = FileInfo::kEmpty; return; }
+
+  TTree *tree = 0;
+  TreeConnector tc;
+  tc.getTree(f, tree, "nominal");
+  if (!tree) { delete f; info.status = FileInfo::kNoTree; return; }
+
+  info.entries = tree->GetEntries();
+  if (info.entries == 0) { delete f; info.status = FileInfo::kEmpty; return; }
+
+  if (isData) tc.setAsData();
+  else tc.setAsMC();
+  tc.init(tree);
+  for (int b = 0; b < (int)tc.branchesRead.size(); ++b)
+    {
+      TBranch *branch = tree->GetBranch(tc.branchesRead[b]);
+      if (branch) info.cost += branch->GetZipBytes();
+    }
+  if (info.cost == 0) info.cost = info.fileBytes;       //Just in case, the file size is the next best guess
+
+  info.status = FileInfo::kGood;
+  delete f;
+}
+
+
+/*
+  Scans the files listed in which (indices into paths) with nThreads
+  threads. info gets an entry for every path; the others are left alone.
+*/
+void scanFiles(const vector<TString> &paths, const vector<int> &which, const vector<bool> &isData,
+	       int nThreads, int delayMs, vector<FileInfo> &info)
+{
+  info.resize(paths.size());
+  std::atomic<int> next(0);
+
+  auto worker = [&]()
+    {
+      int n;
+      while ((n = next++) < (int)which.size()) scanFile(paths[which[n]], isData[which[n]], delayMs, info[which[n]]);
+    };
+
+  if (nThreads > (int)which.size()) nThreads = which.size();
+  if (nThreads <= 1) worker();
+  else
+    {
+      vector<std::thread> pool;
+      for (int t = 0; t < nThreads; ++t) pool.push_back(std::thread(worker));
+      for (int t = 0; t < nThreads; ++t) pool[t].join();
+    }
+}
+
+
+/*
+  Lists the files of which that can't be used, and returns how many there
+  are
+*/
+int reportBadFiles(const vector<TString> &paths, const vector<int> &which, const vector<FileInfo> &info)
+{
+  int nBad = 0, nEmpty = 0;
+  for (int n = 0; n < (int)which.size(); ++n)
+    {
+      const FileInfo &fi = info[which[n]];
+      if (fi.status == FileInfo::kEmpty) ++nEmpty;
+      if (fi.status == FileInfo::kGood || fi.status == FileInfo::kEmpty) continue;
+
+      if (nBad++ == 0) std::cout << "Files left out of the run:" << std::endl;
+      std::cout << "  file " << std::setw(5) << which[n]+1 << "  " << std::setw(16) << std::left
+		<< statusName(fi.status) << std::right << paths[which[n]] << std::endl;
+    }
+  if (nEmpty > 0) std::cout << nEmpty << " empty files skipped" << std::endl;
+  return nBad;
+}
+
+
+/*
+  Gives the files to the workers, most expensive first, each to the worker
+  with the least cost so far
+*/
+WorkPlan::WorkPlan(const vector<FileInfo> &info_in, const vector<int> &files, int nWorkers)
+  : info(info_in), fileOrder(files), assigned(info_in.size(), -1), load(nWorkers, 0)
+{
+  std::stable_sort(fileOrder.begin(), fileOrder.end(),
+		   [&](int a, int b) { return info[a].cost > info[b].cost; });
+
+  for (int n = 0; n < (int)fileOrder.size(); ++n)
+    {
+      int w = std::min_element(load.begin(), load.end()) - load.begin();
+      assigned[fileOrder[n]] = w;
+      load[w] += info[fileOrder[n]].cost;
+    }
+}
+
+
+/*
+  Prints the cost given to every worker
+*/
+void WorkPlan::report() const
+{
+  Long64_t total = 0, most = 0;
+  for (int w = 0; w < (int)load.size(); ++w) { total += load[w]; most = std::max(most, load[w]); }
+
+  std::cout << "Work plan: " << fileOrder.size() << " files, " << std::fixed << std::setprecision(1)
+	    << total/1e6 << " MB to read";
+  if (total > 0 && load.size() > 1)
+    std::cout << ", largest worker share " << most/1e6 << " MB (" << 100.0*most*load.size()/total << "% of even)";
+  std::cout << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+  std::cout << std::setprecision(6);
+}
+
+
+/*
+  Writes the plan to a text file: one line per file, in the order they are
+  started, with the worker, entries, cost in MB and path
+*/
+bool WorkPlan::write(const std::string &path, const vector<TString> &paths) const
+{
+  std::ofstream str(path.c_str());
+  if (str.fail()) return false;
+
+  str << "# worker\tfile\tentries\tMB\tpath" << std::endl << std::fixed << std::setprecision(3);
+  for (int n = 0; n < (int)fileOrder.size(); ++n)
+    {
+      int i = fileOrder[n];
+      str << assigned[i] << "\t" << i+1 << "\t" << info[i].entries << "\t" << info[i].cost/1e6 << "\t" << paths[i] << std::endl;
+    }
+  return !str.fail();
+}
+
+
+
+#endif /*FILEPLAN_H*/
@@ -0,0 +1,336 @@
+//////
+//This class adds up partial histogram files made by dmcHist (the same
+//<sample>.root or <manifest>.root from different jobs) into one file with
+//exactly the same directories, histograms and parameters, so dmcMake and
+//makePlots can read it in place of a file made in a single run.
+//
+//Only one key is in memory at a time: for every histogram, the copies in
+//all the input files are read and added up, then the sum is written and
+//deleted before the next key is read. The copies are added pairwise in a
+//binary tree over the input files (sorted by path), and the branches of
+//the tree near its root are added by different threads at once, each
+//reading its own input files. The shape of the tree only depends on the
+//number of files, so the sums are bin for bin the same for any number of
+//threads and any order the files are given in.
+//
+//The TParameters entries, sumw and sumw2 (see WeightIndex.h) are added up
+//too; any other parameter (like the color and isData of a manifest
+//sample) has to be the same in every file. Every file has to have the same
+//keys as the first, and histograms with the same name the same bins,
+//otherwise std::invalid_argument is thrown.
+//////
+
+#ifndef HISTFILEMERGER_H
+#define HISTFILEMERGER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+#include <unistd.h>
+#include "TSystem.h"
+#include "TFile.h"
+#include "TDirectory.h"
+#include "TKey.h"
+#include "TClass.h"
+#include "TList.h"
+#include "TH1.h"
+#include "TParameter.h"
+#include "TString.h"
+using std::vector;
+
+
+class HistFileMerger
+{
+ public:
+  HistFileMerger(const vector<TString> &inputs, int nThreads);
+  ~HistFileMerger();
+
+  void open();
+  void merge(const TString &output);
+
+  int nInputs() const { return paths.size(); }
+  int nKeys() const { return keys.size(); }
+  int nHists() const { return nHistKeys; }
+
+ private:
+  struct Key
+  {
+    std::string dir;            //Path of the directory it is in ("" for the top)
+    std::string name;
+    std::string className;
+    std::string title;          //Only kept for directories
+  };
+
+  static bool isHist(const Key &key);
+  static void findKeys(TDirectory *dir, const std::string &path, vector<Key> &found);
+  TObject *read(int input, const Key &key);
+  TH1 *reduce(const Key &key, int first, int last, int threads);
+  template <class T> TObject *mergeParameter(const Key &key);
+  void write(TFile *out);
+
+  vector<TString> paths;
+  vector<TFile*> files;
+  vector<Key> keys;
+  int nThreads;
+  int nHistKeys;
+};
+
+
+HistFileMerger::HistFileMerger(const vector<TString> &inputs, int nThreads)
+  : paths(inputs), nThreads(nThreads < 1 ? 1 : nThreads), nHistKeys(0)
+{
+  std::sort(paths.begin(), paths.end());
+  for (int i = 1; i < (int)paths.size(); ++i)
+    if (paths[i] == paths[i-1]) throw std::invalid_argument(std::string(paths[i].Data()) + " is given more than once");
+}
+
+
+HistFileMerger::~HistFileMerger()
+{
+  for (int i = 0; i < (int)files.size(); ++i) delete files[i];
+}
+
+
+/*
+  Opens every input file (with several threads, they may be on /eos/) and
+  checks that they all have the same keys as the first one
+*/
+void HistFileMerger::open()
+{
+  if (paths.empty()) throw std::invalid_argument("No input files");
+
+  files.assign(paths.size(), 0);
+  vector<vector<Key> > found(paths.size());
+  std::atomic<int> next(0);
+
+  auto worker = [&]()
+    {
+      int i;
+      while ((i = next++) < (int)paths.size())
+	{
+	  if (gSystem->AccessPathName(paths[i])) continue;
+	  files[i] = TFile::Open(paths[i], "READ");
+	  if (files[i] && files[i]->IsZombie()) { delete files[i]; files[i] = 0; }
+	  if (files[i]) findKeys(files[i], "", found[i]);
+	}
+    };
+
+  int n = std::min(nThreads, (int)paths.size());
+  if (n <= 1) worker();
+  else
+    {
+      vector<std::thread> pool;
+      for (int t = 0; t < n; ++t) pool.push_back(std::thread(worker));
+      for (int t = 0; t < n; ++t) pool[t].join();
+    }
+
+  for (int i = 0; i < (int)paths.size(); ++i)
+    {
+      if (!files[i]) throw std::invalid_argument(std::string(paths[i].Data()) + " could not be opened");
+
+      bool same = (found[i].size() == found[0].size());
+      for (int k = 0; same && k < (int)found[0].size(); ++k)
+	same = (found[i][k].dir == found[0][k].dir && found[i][k].name == found[0][k].name
+		&& found[i][k].className == found[0][k].className);
+      if (!same) throw std::invalid_argument(std::string(paths[i].Data()) + " doesn't have the same keys as " + paths[0].Data());
+    }
+
+  keys = found[0];
+  nHistKeys = 0;
+  for (int k = 0; k < (int)keys.size(); ++k)
+    if (isHist(keys[k])) ++nHistKeys;
+}
+
+
+/*
+  Adds the keys of dir and of the directories in it to found, in the order
+  they are in the file (only the last cycle of every name)
+*/
+void HistFileMerger::findKeys(TDirectory *dir, const std::string &path, vector<Key> &found)
+{
+  vector<std::string> seen;
+  TIter next(dir->GetListOfKeys());
+  TKey *key;
+  while ((key = (TKey*)next()))
+    {
+      std::string name(key->GetName());
+      if (std::find(seen.begin(), seen.end(), name) != seen.end()) continue;
+      seen.push_back(name);
+
+      Key k = { path, name, key->GetClassName(), "" };
+      if (k.className == "TDirectoryFile" || k.className == "TDirectory")
+	{
+	  k.title = key->GetTitle();
+	  found.push_back(k);
+	  findKeys(dir->GetDirectory(name.c_str()), path.empty() ? name : path + "/" + name, found);
+	}
+      else found.push_back(k);
+    }
+}
+
+
+bool HistFileMerger::isHist(const Key &key)
+{
+  TClass *cl = TClass::GetClass(key.className.c_str());
+  return cl && cl->InheritsFrom(TH1::Class());
+}
+
+
+/*
+  Reads one key of one input file (the caller owns it)
+*/
+TObject *HistFileMerger::read(int input, const Key &key)
+{
+  std::string path = key.dir.empty() ? key.name : key.dir + "/" + key.name;
+  TObject *obj = files[input]->Get(path.c_str());
+  if (!obj) throw std::invalid_argument(path + " could not be read from " + paths[input].Data());
+  return obj;
+}
+
+
+/*
+  Adds up one histogram of the input files first to last-1: the two halves
+  are added up first (by different threads when there are several), then
+  added together
+*/
+TH1 *HistFileMerger::reduce(const Key &key, int first, int last, int threads)
+{
+  if (last - first == 1)
+    {
+      TH1 *h = dynamic_cast<TH1*>(read(first, key));
+      if (!h) throw std::invalid_argument(key.name + " in " + paths[first].Data() + " isn't a histogram");
+      return h;
+    }
+
+  int middle = first + (last - first)/2;
+  TH1 *left = 0, *right = 0;
+  if (threads > 1)
+    {
+      std::exception_ptr leftError, rightError;
+      std::thread other([&]()
+	{
+	  try { right = reduce(key, middle, last, threads - threads/2); }
+	  catch (...) { rightError = std::current_exception(); }
+	});
+      try { left = reduce(key, first, middle, threads/2); }
+      catch (...) { leftError = std::current_exception(); }
+      other.join();
+
+      if (leftError || rightError)
+	{
+	  delete left; delete right;
+	  std::rethrow_exception(leftError ? leftError : rightError);
+	}
+    }
+  else
+    {
+      left = reduce(key, first, middle, 1);
+      try { right = reduce(key, middle, last, 1); }
+      catch (...) { delete left; throw; }
+    }
+
+  bool added = left->Add(right);
+  delete right;
+  if (!added)
+    {
+      delete left;
+      throw std::invalid_argument(key.name + " doesn't have the same bins in all the files");
+    }
+  return left;
+}
+
+
+/*
+  Adds up entries, sumw and sumw2, and checks that any other parameter is
+  the same in every file. The files are taken in order, so the sums are
+  always the same.
+*/
+template <class T>
+TObject *HistFileMerger::mergeParameter(const Key &key)
+{
+  TParameter<T> *sum = dynamic_cast<TParameter<T>*>(read(0, key));
+  bool add = (key.name == "entries" || key.name == "sumw" || key.name == "sumw2");
+
+  for (int i = 1; i < (int)files.size(); ++i)
+    {
+      TParameter<T> *p = dynamic_cast<TParameter<T>*>(read(i, key));
+      T value = p->GetVal();
+      delete p;
+
+      if (add) sum->SetVal(sum->GetVal() + value);
+      else if (value != sum->GetVal())
+	{
+	  delete sum;
+	  throw std::invalid_argument(key.dir + "/" + key.name + " is different in " + paths[i].Data());
+	}
+    }
+  return sum;
+}
+
+
+/*
+  Merges the input files into output. The file is written under a
+  temporary name and renamed at the end, so a merge that fails never
+  leaves a file that looks complete.
+*/
+void HistFileMerger::merge(const TString &output)
+{
+  for (int i = 0; i < (int)paths.size(); ++i)
+    if (paths[i] == output) throw std::invalid_argument(std::string(output.Data()) + " is also an input file");
+  if (files.empty()) open();
+
+  TString tmp = output + TString::Format(".part%d", (int)getpid());
+  TFile *out = TFile::Open(tmp, "RECREATE");
+  if (!out || out->IsZombie()) { delete out; throw std::invalid_argument(std::string(tmp.Data()) + " could not be made"); }
+
+  try { write(out); }
+  catch (...) { delete out; gSystem->Unlink(tmp); throw; }
+
+  out->Close();
+  delete out;
+  if (gSystem->Rename(tmp, output) != 0)
+    {
+      gSystem->Unlink(tmp);
+      throw std::invalid_argument(std::string(output.Data()) + " could not be written");
+    }
+}
+
+
+/*
+  Writes every key, one at a time
+*/
+void HistFileMerger::write(TFile *out)
+{
+  for (int k = 0; k < (int)keys.size(); ++k)
+    {
+      const Key &key = keys[k];
+      TDirectory *dir = key.dir.empty() ? (TDirectory*)out : out->GetDirectory(key.dir.c_str());
+
+      if (key.className == "TDirectoryFile" || key.className == "TDirectory")
+	{
+	  dir->mkdir(key.name.c_str(), key.title.c_str());
+	  continue;
+	}
+
+      TObject *obj = 0;
+      if (isHist(key)) obj = reduce(key, 0, files.size(), nThreads);
+      else if (key.className == "TParameter<double>") obj = mergeParameter<double>(key);
+      else if (key.className == "TParameter<Long64_t>" || key.className == "TParameter<long long>") obj = mergeParameter<Long64_t>(key);
+      else if (key.className == "TParameter<int>") obj = mergeParameter<int>(key);
+      else if (key.className == "TParameter<bool>") obj = mergeParameter<bool>(key);
+      else obj = read(0, key);                    //Anything else is copied from the first file
+
+      dir->cd();
+      obj->Write(key.name.c_str());
+      delete obj;
+    }
+}
+
+
+
+#endif /*HISTFILEMERGER_H*/
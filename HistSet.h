@@ -0,0 +1,662 @@
+//////
+//This class holds one complete set of the dmcHist histograms (the large jet
+//Pt, Eta, Phi, and Mass histograms, the small jet Pt, Eta, and Phi
+//histograms, and the histograms of the derived quantities in DerivedVars.h:
+//dR12, mjj, HT, the number of small jets, the leading large jet Pt in
+//sections of dR12, whose names contain "FLAG" for makePlots, and the
+//number and leading Pt of the small jets matched to each large jet). Every
+//worker thread in dmcHist fills its own HistSet so that no histogram is
+//ever touched by two threads at once, and the sets are added together at
+//the end with add(). The histograms are not attached to
+//any directory, so closing an input file never deletes them.
+//
+//fillBatch() fills UniformHists (see UniformHist.h) with whole columns of
+//values instead of calling TH1F::Fill for every one, and flush() copies
+//them into the TH1Fs, which have to be empty until then. The TH1Fs come
+//out exactly as if every value had been filled with TH1F::Fill.
+//
+//SerialFiller fills one HistSet range after range, for a run on one
+//thread: every event goes straight into the set in entry order, and what
+//fillBatch() filled is only flushed at the very end, so the set comes out
+//exactly as the serial loop over the events made it.
+//
+//HistMerger collects the sets filled for every range of every file and
+//adds them up in a fixed order: the ranges of a file in entry order, then
+//the files in the order of the text file. Which thread filled a range, or
+//when it finished, never changes the result. When several samples are made
+//in one run, every file is added to the total of its own sample. A
+//function given to onFileDone() is called with the sum of each file as
+//soon as all of its ranges are in (this is how checkpoints are saved). It
+//is called after the merger is unlocked, so saving a file doesn't hold up
+//the threads handing in their ranges.
+//////
+
+#ifndef HISTSET_H
+#define HISTSET_H
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include "TH1F.h"
+#include "TDirectory.h"
+#include "TreeConnector.h"
+#include "UniformHist.h"
+#include "DerivedVars.h"
+using std::vector;
+
+
+class HistSet
+{
+ public:
+  static const int n_ljet_hists = 2;     //Number of large jet histograms (0 is leading jet, 1 is second leading, etc.)
+  static const int n_jet_hists = 3;      //Number of small jet histograms
+  static const int n_dR12_sections = 6;  //Sections of dR12 with a leading large jet Pt histogram
+
+  static int dR12Section(Float_t dR12);
+
+  HistSet(int nbins);
+  ~HistSet();
+
+  void fill(TreeConnector &tc, Float_t totalWeight);
+  void fillBatch(const EventBatch &batch);
+  void flush();
+  void add(const HistSet &other);
+  void write(TDirectory *dir) const;
+  bool read(TDirectory *dir);
+
+  int nbins;
+
+  vector<TH1F*> h_ljet_pt, h_ljet_eta, h_ljet_phi, h_ljet_m;
+  vector<TH1F*> h_jet_pt, h_jet_eta, h_jet_phi;
+  TH1F *h_ljet_dR12, *h_ljet_mjj, *h_jet_HT, *h_jet_n;
+  vector<TH1F*> h_ljet_pt0_FLAG;          //Leading large jet Pt in each section of dR12
+  vector<TH1F*> h_ljet_nmatch, h_ljet_matchpt;   //Small jets matched to each large jet, and the Pt of the leading one
+
+  vector<TH1F*> all() const;
+
+ private:
+  void fillDerived(DerivedVars &derived, int nLjets, Float_t ljetPt0, Float_t totalWeight);
+  void gatherEvents(const EventBatch &batch, const vector<char> &pass);
+  void gather(const EventBatch &batch, const vector<int> &offsets, int index);
+  void fillFast(int h, const vector<Float_t> &values);
+
+  vector<UniformHistF*> fast;               //What fillBatch filled and flush hasn't copied yet, in the order of all()
+  vector<int> gathered;                     //Positions in the batch of the jets being filled
+  vector<Float_t> xbuf, wbuf;
+  vector<char> selected;
+  DerivedColumns derived;
+  JetMatcher matcher;
+
+  HistSet(const HistSet &);                 //Sets own their histograms, so don't copy them
+  HistSet &operator=(const HistSet &);
+};
+
+
+/*
+  Makes the empty histograms and numbers them
+*/
+HistSet::HistSet(int nbins_in)
+  : nbins(nbins_in),
+    h_ljet_pt(n_ljet_hists), h_ljet_eta(n_ljet_hists), h_ljet_phi(n_ljet_hists), h_ljet_m(n_ljet_hists),
+    h_jet_pt(n_jet_hists), h_jet_eta(n_jet_hists), h_jet_phi(n_jet_hists),
+    h_ljet_pt0_FLAG(n_dR12_sections), h_ljet_nmatch(n_ljet_hists), h_ljet_matchpt(n_ljet_hists)
+{
+  static_assert(n_ljet_hists <= nLeading, "DerivedVars only matches small jets to nLeading large jets");
+
+  bool addDir = TH1::AddDirectoryStatus();
+  TH1::AddDirectory(kFALSE);                //Keep the histograms out of gDirectory (it is per thread)
+
+  std::stringstream ss;
+
+  for(int i=0; i < n_ljet_hists; ++i)
+    {
+      ss<<i;
+      std::string jnum = ss.str();
+
+      h_ljet_pt[i]  = new TH1F((std::string("h_ljet_pt")+jnum).c_str(),  (std::string("Large Jet Pt[")+jnum+std::string("]")).c_str(),  nbins, 0, 2000000);
+      h_ljet_eta[i] = new TH1F((std::string("h_ljet_eta")+jnum).c_str(), (std::string("Large Jet Eta[")+jnum+std::string("]")).c_str(), nbins, -3, 3);
+      h_ljet_phi[i] = new TH1F((std::string("h_ljet_phi")+jnum).c_str(), (std::string("Large Jet Phi[")+jnum+std::string("]")).c_str(), nbins, -4, 4);
+      h_ljet_m[i]   = new TH1F((std::string("h_ljet_m")+jnum).c_str(),   (std::string("Large Jet Mass[")+jnum+std::string("]")).c_str(), nbins, 0, 250000);
+      ss.str(std::string());     //Clears the stringstream
+    }
+
+  for(int j=0; j < n_jet_hists; ++j)
+    {
+      ss<<j;
+      std::string jnum = ss.str();
+
+      h_jet_pt[j]  = new TH1F((std::string("h_jet_pt")+jnum).c_str(),  (std::string("Pt[")+jnum+std::string("]")).c_str(),  nbins, 0, 2000000);
+      h_jet_eta[j] = new TH1F((std::string("h_jet_eta")+jnum).c_str(), (std::string("Eta[")+jnum+std::string("]")).c_str(), nbins, -3, 3);
+      h_jet_phi[j] = new TH1F((std::string("h_jet_phi")+jnum).c_str(), (std::string("Phi[")+jnum+std::string("]")).c_str(),  nbins, -4, 4);
+      ss.str(std::string());     //Clears the stringstream
+    }
+
+  h_ljet_dR12 = new TH1F("h_ljet_dR12", "Large Jet dR12",             nbins, 0, 6);
+  h_ljet_mjj  = new TH1F("h_ljet_mjj",  "Large Jet Dijet Mass",       nbins, 0, 5000000);
+  h_jet_HT    = new TH1F("h_jet_HT",    "HT",                         nbins, 0, 5000000);
+  h_jet_n     = new TH1F("h_jet_n",     "Number of Small Jets",       20, -0.5, 19.5);
+
+  const char *sections[n_dR12_sections] = { "#DeltaR_{12} < 1.0", "1.0 < #DeltaR_{12} < 1.5", "1.5 < #DeltaR_{12} < 2.0",
+					    "2.0 < #DeltaR_{12} < 2.5", "2.5 < #DeltaR_{12} < 3.0", "#DeltaR_{12} > 3.0" };
+  for(int s=0; s < n_dR12_sections; ++s)
+    {
+      ss<<s;
+      h_ljet_pt0_FLAG[s] = new TH1F((std::string("h_ljet_pt0_FLAG_dR12_")+ss.str()).c_str(), sections[s], nbins, 0, 2000000);
+      ss.str(std::string());
+    }
+
+  for(int i=0; i < n_ljet_hists; ++i)
+    {
+      ss<<i;
+      std::string jnum = ss.str();
+
+      h_ljet_nmatch[i]  = new TH1F((std::string("h_ljet_nmatch")+jnum).c_str(),  (std::string("Small Jets in Large Jet[")+jnum+std::string("]")).c_str(), 10, -0.5, 9.5);
+      h_ljet_matchpt[i] = new TH1F((std::string("h_ljet_matchpt")+jnum).c_str(), (std::string("Leading Small Jet Pt in Large Jet[")+jnum+std::string("]")).c_str(), nbins, 0, 2000000);
+      ss.str(std::string());
+    }
+
+  TH1::AddDirectory(addDir);
+}
+
+HistSet::~HistSet()
+{
+  for(int i=0; i < n_ljet_hists; ++i)
+    {
+      delete h_ljet_pt[i]; delete h_ljet_eta[i]; delete h_ljet_phi[i]; delete h_ljet_m[i];
+    }
+  for(int j=0; j < n_jet_hists; ++j)
+    {
+      delete h_jet_pt[j]; delete h_jet_eta[j]; delete h_jet_phi[j];
+    }
+  delete h_ljet_dR12; delete h_ljet_mjj; delete h_jet_HT; delete h_jet_n;
+  for(int s=0; s < n_dR12_sections; ++s) delete h_ljet_pt0_FLAG[s];
+  for(int i=0; i < n_ljet_hists; ++i) { delete h_ljet_nmatch[i]; delete h_ljet_matchpt[i]; }
+  for(int h=0; h < (int)fast.size(); ++h) delete fast[h];
+}
+
+
+/*
+  Section of dR12 that an event with two large jets is in: the edges are
+  1.0, 1.5, 2.0, 2.5 and 3.0
+*/
+int HistSet::dR12Section(Float_t dR12)
+{
+  static const Float_t edges[n_dR12_sections-1] = { 1.0, 1.5, 2.0, 2.5, 3.0 };
+  int s = 0;
+  while (s < n_dR12_sections-1 && dR12 >= edges[s]) ++s;
+  return s;
+}
+
+
+/*
+  Every histogram of the set: the large jet Pt, Eta, Phi, Mass of each
+  jet, the small jet Pt, Eta, Phi of each jet, then dR12, mjj, HT, the
+  number of small jets, the dR12 sections, and the matched small jets of
+  each large jet
+*/
+vector<TH1F*> HistSet::all() const
+{
+  vector<TH1F*> hists;
+  for(int i=0; i < n_ljet_hists; ++i)
+    {
+      hists.push_back(h_ljet_pt[i]); hists.push_back(h_ljet_eta[i]); hists.push_back(h_ljet_phi[i]); hists.push_back(h_ljet_m[i]);
+    }
+  for(int j=0; j < n_jet_hists; ++j)
+    {
+      hists.push_back(h_jet_pt[j]); hists.push_back(h_jet_eta[j]); hists.push_back(h_jet_phi[j]);
+    }
+  hists.push_back(h_ljet_dR12); hists.push_back(h_ljet_mjj); hists.push_back(h_jet_HT); hists.push_back(h_jet_n);
+  for(int s=0; s < n_dR12_sections; ++s) hists.push_back(h_ljet_pt0_FLAG[s]);
+  for(int i=0; i < n_ljet_hists; ++i) { hists.push_back(h_ljet_nmatch[i]); hists.push_back(h_ljet_matchpt[i]); }
+  return hists;
+}
+
+
+/*
+  Fills the histograms from the event currently loaded in the TreeConnector
+*/
+void HistSet::fill(TreeConnector &tc, Float_t totalWeight)
+{
+  for(int nlj = 0; nlj < n_ljet_hists; ++nlj)
+    {
+      if(tc.ljet_pt->size() > nlj)
+	{
+	  h_ljet_pt[nlj]->Fill(tc.ljet_pt->at(nlj),   totalWeight);
+	  h_ljet_eta[nlj]->Fill(tc.ljet_eta->at(nlj), totalWeight);
+	  h_ljet_phi[nlj]->Fill(tc.ljet_phi->at(nlj), totalWeight);
+	  h_ljet_m[nlj]->Fill(tc.ljet_m->at(nlj),     totalWeight);
+	}
+    }
+
+  for(int nj = 0; nj < n_jet_hists; ++nj)
+    {
+      if(tc.jet_pt->size() > nj)
+	{
+	  h_jet_pt[nj]->Fill(tc.jet_pt->at(nj),   totalWeight);
+	  h_jet_eta[nj]->Fill(tc.jet_eta->at(nj), totalWeight);
+	  h_jet_phi[nj]->Fill(tc.jet_phi->at(nj), totalWeight);
+	}
+    }
+
+  DerivedVars derived(tc, matcher);
+  fillDerived(derived, tc.ljet_pt->size(), tc.ljet_pt->empty() ? 0 : tc.ljet_pt->at(0), totalWeight);
+}
+
+
+/*
+  Fills the histograms of the derived quantities of one event. dR12, mjj
+  and the sections only exist for events with two large jets.
+*/
+void HistSet::fillDerived(DerivedVars &derived, int nLjets, Float_t ljetPt0, Float_t totalWeight)
+{
+  if (derived.hasPair())
+    {
+      h_ljet_dR12->Fill(derived.dR12(), totalWeight);
+      h_ljet_mjj->Fill(derived.mjj(),   totalWeight);
+      h_ljet_pt0_FLAG[dR12Section(derived.dR12())]->Fill(ljetPt0, totalWeight);
+    }
+  h_jet_HT->Fill(derived.HT(),     totalWeight);
+  h_jet_n->Fill(derived.nJets(),   totalWeight);
+
+  for(int i = 0; i < n_ljet_hists && i < nLjets; ++i)
+    {
+      h_ljet_nmatch[i]->Fill(derived.nMatched(i), totalWeight);
+      if(derived.nMatched(i) > 0) h_ljet_matchpt[i]->Fill(derived.matchedPt(i), totalWeight);
+    }
+}
+
+
+/*
+  Fills the histograms from every event of a batch. The histograms see the
+  same values in the same order as calling fill() event by event, but they
+  only show up in the TH1Fs after flush().
+*/
+void HistSet::fillBatch(const EventBatch &batch)
+{
+  if (fast.empty())
+    {
+      vector<TH1F*> hists = all();
+      for(int h=0; h < (int)hists.size(); ++h)
+	fast.push_back(new UniformHistF(hists[h]->GetNbinsX(), hists[h]->GetXaxis()->GetXmin(), hists[h]->GetXaxis()->GetXmax()));
+    }
+
+  int h = 0;
+  for(int nlj = 0; nlj < n_ljet_hists; ++nlj)
+    {
+      gather(batch, batch.ljet_offsets, nlj);
+      fillFast(h++, batch.ljet_pt);
+      fillFast(h++, batch.ljet_eta);
+      fillFast(h++, batch.ljet_phi);
+      fillFast(h++, batch.ljet_m);
+    }
+
+  for(int nj = 0; nj < n_jet_hists; ++nj)
+    {
+      gather(batch, batch.jet_offsets, nj);
+      fillFast(h++, batch.jet_pt);
+      fillFast(h++, batch.jet_eta);
+      fillFast(h++, batch.jet_phi);
+    }
+
+  derived.newBatch(batch);
+  const vector<char> &pair = derived.hasPair();
+  gatherEvents(batch, pair);
+  fillFast(h++, derived.dR12());
+  fillFast(h++, derived.mjj());
+
+  selected.assign(batch.nEvents, 1);
+  gatherEvents(batch, selected);
+  fillFast(h++, derived.HT());
+  fillFast(h++, derived.nJets());
+
+  const vector<Float_t> &dR12 = derived.dR12();
+  for(int s = 0; s < n_dR12_sections; ++s)
+    {
+      for(Long64_t e = 0; e < batch.nEvents; ++e) selected[e] = pair[e] && dR12Section(dR12[e]) == s;
+      gatherEvents(batch, selected);
+      fillFast(h++, derived.leadingPt());
+    }
+
+  for(int i = 0; i < n_ljet_hists; ++i)
+    {
+      const vector<Float_t> &nMatched = derived.nMatched(i);
+      for(Long64_t e = 0; e < batch.nEvents; ++e) selected[e] = batch.ljet_offsets[e+1] - batch.ljet_offsets[e] > i;
+      gatherEvents(batch, selected);
+      fillFast(h++, nMatched);
+
+      for(Long64_t e = 0; e < batch.nEvents; ++e) selected[e] = nMatched[e] > 0;
+      gatherEvents(batch, selected);
+      fillFast(h++, derived.matchedPt(i));
+    }
+}
+
+
+/*
+  Finds the jet number index of every event of the batch that has one, and
+  the weights of those events
+*/
+void HistSet::gather(const EventBatch &batch, const vector<int> &offsets, int index)
+{
+  gathered.clear();
+  wbuf.clear();
+  for(Long64_t e = 0; e < batch.nEvents; ++e)
+    if(offsets[e+1] - offsets[e] > index)
+      {
+	gathered.push_back(offsets[e] + index);
+	wbuf.push_back(batch.weight[e]);
+      }
+}
+
+
+/*
+  Finds the events of the batch where pass is set, and their weights
+*/
+void HistSet::gatherEvents(const EventBatch &batch, const vector<char> &pass)
+{
+  gathered.clear();
+  wbuf.clear();
+  for(Long64_t e = 0; e < batch.nEvents; ++e)
+    if(pass[e])
+      {
+	gathered.push_back(e);
+	wbuf.push_back(batch.weight[e]);
+      }
+}
+
+
+/*
+  Fills fast histogram h with the values of the gathered jets (or events)
+*/
+void HistSet::fillFast(int h, const vector<Float_t> &values)
+{
+  xbuf.resize(gathered.size());
+  for(int i = 0; i < (int)gathered.size(); ++i) xbuf[i] = values[gathered[i]];
+
+  if (!xbuf.empty()) fast[h]->fill(&xbuf[0], &wbuf[0], xbuf.size());
+}
+
+
+/*
+  Copies what fillBatch filled into the TH1Fs
+*/
+void HistSet::flush()
+{
+  vector<TH1F*> hists = all();
+  for(int h=0; h < (int)fast.size(); ++h)
+    {
+      fast[h]->copyTo(hists[h]);
+      delete fast[h];
+    }
+  fast.clear();
+}
+
+
+/*
+  Adds the contents of another set into this one. Adding is done in the
+  same fixed order every time, so the result only depends on the order
+  in which the sets are added, not on which thread filled them.
+*/
+void HistSet::add(const HistSet &other)
+{
+  for(int i=0; i < n_ljet_hists; ++i)
+    {
+      h_ljet_pt[i]->Add(other.h_ljet_pt[i]);
+      h_ljet_eta[i]->Add(other.h_ljet_eta[i]);
+      h_ljet_phi[i]->Add(other.h_ljet_phi[i]);
+      h_ljet_m[i]->Add(other.h_ljet_m[i]);
+    }
+
+  for(int j=0; j < n_jet_hists; ++j)
+    {
+      h_jet_pt[j]->Add(other.h_jet_pt[j]);
+      h_jet_eta[j]->Add(other.h_jet_eta[j]);
+      h_jet_phi[j]->Add(other.h_jet_phi[j]);
+    }
+
+  h_ljet_dR12->Add(other.h_ljet_dR12);
+  h_ljet_mjj->Add(other.h_ljet_mjj);
+  h_jet_HT->Add(other.h_jet_HT);
+  h_jet_n->Add(other.h_jet_n);
+  for(int s=0; s < n_dR12_sections; ++s) h_ljet_pt0_FLAG[s]->Add(other.h_ljet_pt0_FLAG[s]);
+  for(int i=0; i < n_ljet_hists; ++i)
+    {
+      h_ljet_nmatch[i]->Add(other.h_ljet_nmatch[i]);
+      h_ljet_matchpt[i]->Add(other.h_ljet_matchpt[i]);
+    }
+}
+
+
+/*
+  Writes every histogram into dir
+*/
+void HistSet::write(TDirectory *dir) const
+{
+  dir->cd();
+
+  for(int i=0; i < n_ljet_hists; ++i)
+    {
+      h_ljet_pt[i]->Write(h_ljet_pt[i]->GetName());
+      h_ljet_eta[i]->Write(h_ljet_eta[i]->GetName());
+      h_ljet_phi[i]->Write(h_ljet_phi[i]->GetName());
+      h_ljet_m[i]->Write(h_ljet_m[i]->GetName());
+    }
+
+  for(int j=0; j < n_jet_hists; ++j)
+    {
+      h_jet_pt[j]->Write(h_jet_pt[j]->GetName());
+      h_jet_eta[j]->Write(h_jet_eta[j]->GetName());
+      h_jet_phi[j]->Write(h_jet_phi[j]->GetName());
+    }
+
+  h_ljet_dR12->Write(h_ljet_dR12->GetName());
+  h_ljet_mjj->Write(h_ljet_mjj->GetName());
+  h_jet_HT->Write(h_jet_HT->GetName());
+  h_jet_n->Write(h_jet_n->GetName());
+  for(int s=0; s < n_dR12_sections; ++s) h_ljet_pt0_FLAG[s]->Write(h_ljet_pt0_FLAG[s]->GetName());
+  for(int i=0; i < n_ljet_hists; ++i)
+    {
+      h_ljet_nmatch[i]->Write(h_ljet_nmatch[i]->GetName());
+      h_ljet_matchpt[i]->Write(h_ljet_matchpt[i]->GetName());
+    }
+}
+
+
+/*
+  Adds the histograms that write() saved in dir to this set. Returns false
+  if one is missing or has a different number of bins.
+*/
+bool HistSet::read(TDirectory *dir)
+{
+  vector<TH1F*> mine = all();
+
+  for(int h=0; h < (int)mine.size(); ++h)
+    {
+      TH1F *saved = (TH1F*)dir->Get(mine[h]->GetName());
+      if(!saved || saved->GetNbinsX() != mine[h]->GetNbinsX()) { delete saved; return false; }
+      mine[h]->Add(saved);
+      delete saved;
+    }
+
+  return true;
+}
+
+
+class SerialFiller
+{
+ public:
+  SerialFiller(HistSet &hists_in) : hists(&hists_in) {}
+
+  void fill(TreeConnector &tc, Float_t totalWeight) { hists->fill(tc, totalWeight); }
+  void fillBatch(const EventBatch &batch) { hists->fillBatch(batch); }
+  void flush() {}                           //Only once every range is in, with HistSet::flush()
+
+ private:
+  HistSet *hists;
+};
+
+
+
+class HistMerger
+{
+ public:
+  HistMerger(const vector<int> &fileSample, vector<HistSet*> &totals);
+  ~HistMerger();
+
+  typedef std::function<void(int fileNum, const HistSet *sum)> FileDone;
+
+  void setParts(int fileNum, int nParts);
+  void addPart(int fileNum, int part, HistSet *hists);
+  bool complete();
+  void onFileDone(FileDone done);
+
+ private:
+  struct FileParts
+  {
+    int nParts;                 //-1 until the file has been split
+    int nextPart;               //Next part to be added to sum
+    vector<HistSet*> parts;     //Finished parts waiting for the ones before them
+    HistSet *sum;               //Sum of the parts added so far
+    bool saving;                //fileDone is running on sum, so it can't be added to the total yet
+  };
+
+  bool mergeFile(int fileNum);
+  void mergeFiles();
+  void fileFinished(int fileNum);
+
+  vector<HistSet*> &totals;     //One total per sample
+  vector<int> fileSample;       //Sample that each file belongs to
+  vector<FileParts> files;
+  int nextFile;                 //Next file to be added to total
+  FileDone fileDone;
+  std::mutex lock;
+};
+
+
+HistMerger::HistMerger(const vector<int> &fileSample_in, vector<HistSet*> &totals_in)
+  : totals(totals_in), fileSample(fileSample_in), files(fileSample_in.size()), nextFile(0)
+{
+  for (int i = 0; i < (int)files.size(); ++i) { files[i].nParts = -1; files[i].nextPart = 0; files[i].sum = 0; files[i].saving = false; }
+}
+
+HistMerger::~HistMerger()               //Only has something to delete if the run was aborted
+{
+  for (int i = 0; i < (int)files.size(); ++i)
+    {
+      for (int p = 0; p < (int)files[i].parts.size(); ++p) delete files[i].parts[p];
+      delete files[i].sum;
+    }
+}
+
+
+/*
+  Tells the merger how many ranges a file was split into. A file that was
+  skipped has 0 parts.
+*/
+void HistMerger::setParts(int fileNum, int nParts)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    files[fileNum].nParts = nParts;
+    files[fileNum].parts.assign(nParts, (HistSet*)0);
+    mergeFiles();
+  }
+  if (nParts == 0 && fileDone) fileDone(fileNum, 0);
+}
+
+
+/*
+  Hands over the histograms filled from one range (the merger deletes them)
+*/
+void HistMerger::addPart(int fileNum, int part, HistSet *hists)
+{
+  bool finished;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    files[fileNum].parts[part] = hists;
+    finished = mergeFile(fileNum);
+    mergeFiles();
+  }
+  if (finished) fileFinished(fileNum);
+}
+
+
+/*
+  True once every file has been added to the total
+*/
+bool HistMerger::complete()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return nextFile == (int)files.size();
+}
+
+
+/*
+  Sets the function called with the sum of every file once it is complete
+  (with 0 for files that were skipped). It is called without the merger
+  locked, so it can run on several threads at once, for different files.
+  Set it before any part is handed over.
+*/
+void HistMerger::onFileDone(FileDone done)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  fileDone = done;
+}
+
+
+/*
+  Adds the parts of a file that are ready, in order. Returns true if the
+  file is complete now and its sum has to be given to fileDone (it is kept
+  out of the total until fileFinished()).
+*/
+bool HistMerger::mergeFile(int fileNum)
+{
+  FileParts &fp = files[fileNum];
+  bool added = false;
+
+  while (fp.nextPart < fp.nParts && fp.parts[fp.nextPart])
+    {
+      if (!fp.sum) fp.sum = fp.parts[fp.nextPart];
+      else { fp.sum->add(*fp.parts[fp.nextPart]); delete fp.parts[fp.nextPart]; }
+      fp.parts[fp.nextPart] = 0;
+      ++fp.nextPart;
+      added = true;
+    }
+
+  fp.saving = added && fp.nextPart == fp.nParts && fileDone;
+  return fp.saving;
+}
+
+
+/*
+  Gives the sum of a complete file to fileDone, outside the lock; nothing
+  else touches the sum until saving is cleared
+*/
+void HistMerger::fileFinished(int fileNum)
+{
+  fileDone(fileNum, files[fileNum].sum);
+
+  std::lock_guard<std::mutex> guard(lock);
+  files[fileNum].saving = false;
+  mergeFiles();
+}
+
+
+/*
+  Adds the finished files to the totals of their samples, in order
+*/
+void HistMerger::mergeFiles()
+{
+  while (nextFile < (int)files.size() && files[nextFile].nParts >= 0
+	 && files[nextFile].nextPart == files[nextFile].nParts && !files[nextFile].saving)
+    {
+      if (files[nextFile].sum) totals[fileSample[nextFile]]->add(*files[nextFile].sum);
+      delete files[nextFile].sum; files[nextFile].sum = 0;
+      ++nextFile;
+    }
+}
+
+
+
+#endif /*HISTSET_H*/
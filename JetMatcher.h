@@ -0,0 +1,92 @@
+//////
+//This class matches the small jets of an event to the large jets they are
+//inside: every small jet goes to the closest large jet within radius in
+//Delta R (1.0, the size of the large jets), or to none.
+//
+//Every pair has to be looked at, so the work grows as small jets times
+//large jets. For each large jet, Delta R^2 to all the small jets is worked
+//out in one loop over the contiguous eta and phi arrays of the small jets
+//(with phi wrapped around), and a second loop keeps the closest large jet
+//of each small jet so far. Both loops are written with std::min and bit
+//masks instead of branches or ?: on comparisons (which GCC won't
+//vectorise without -fno-trapping-math), so the compiler turns them into
+//SIMD instructions (build with -O3). A small jet at the same distance
+//from two large jets goes to the first one.
+//
+//The arrays are kept between events, so one JetMatcher should be reused
+//for every event a thread looks at.
+//////
+
+#ifndef JETMATCHER_H
+#define JETMATCHER_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "Rtypes.h"
+using std::vector;
+
+
+class JetMatcher
+{
+ public:
+  JetMatcher(Float_t radius = 1.0) : radius(radius), nJets(0), nLjets(0) {}
+
+  void match(const Float_t *jetEta, const Float_t *jetPhi, int nJets,
+	     const Float_t *ljetEta, const Float_t *ljetPhi, int nLjets);
+
+  int matched(int j) const { return index[j]; }                      //Large jet of small jet j, -1 if none
+  Float_t dR2(int l, int j) const { return pairs[l*nJets + j]; }    //Delta R^2 between large jet l and small jet j
+
+  Float_t radius;
+
+ private:
+  int nJets, nLjets;
+  vector<Float_t> pairs;      //Delta R^2 of every pair, one row of nJets for each large jet
+  vector<Float_t> best;       //Delta R^2 to the closest large jet so far
+  vector<int> index;
+};
+
+
+/*
+  Matches the small jets (eta and phi arrays of nJets) to the large jets
+*/
+void JetMatcher::match(const Float_t *jetEta, const Float_t *jetPhi, int nJets_in,
+		       const Float_t *ljetEta, const Float_t *ljetPhi, int nLjets_in)
+{
+  const Float_t pi = 3.14159265358979f;
+  nJets = nJets_in;
+  nLjets = nLjets_in;
+
+  int n = nJets;                            //A local bound, so the stores below can't change it
+  if ((int)pairs.size() < n*nLjets) pairs.resize(n*nLjets);
+  best.assign(n, radius*radius);
+  index.assign(n, -1);
+
+  for (int l = 0; l < nLjets; ++l)
+    {
+      Float_t *row = n ? &pairs[l*n] : 0;
+      Float_t eta = ljetEta[l], phi = ljetPhi[l];
+
+      for (int j = 0; j < n; ++j)
+	{
+	  Float_t deta = jetEta[j] - eta;
+	  Float_t dphi = std::fabs(jetPhi[j] - phi);
+	  dphi = std::min(dphi, 2*pi - dphi);
+	  row[j] = deta*deta + dphi*dphi;
+	}
+
+      int *idx = n ? &index[0] : 0;
+      Float_t *closest = n ? &best[0] : 0;
+      for (int j = 0; j < n; ++j)
+	{
+	  int closer = -(row[j] < closest[j]);               //All bits set if large jet l is closer
+	  idx[j] = (l & closer) | (idx[j] & ~closer);
+	  closest[j] = std::min(row[j], closest[j]);
+	}
+    }
+}
+
+
+
+#endif /*JETMATCHER_H*/
@@ -0,0 +1,204 @@
+#include "LazyHists.h"
+#include "TArrayF.h"
+#include "TArrayI.h"
+#include "TArrayS.h"
+#include "TArrayC.h"
+
+
+/*
+  A copy has the file and the limit of other, but none of its histograms
+*/
+LazyHists::LazyHists(const LazyHists &other)
+  : file(other.file), prefetcher(other.prefetcher), sample(other.sample), maxBytes(other.maxBytes), bytes(0), uses(0)
+{
+}
+
+LazyHists &LazyHists::operator=(const LazyHists &other)
+{
+  if (this == &other) return *this;
+  clear();
+  file = other.file; prefetcher = other.prefetcher; sample = other.sample; maxBytes = other.maxBytes;
+  return *this;
+}
+
+LazyHists::~LazyHists()
+{
+  clear();
+}
+
+
+/*
+  Deletes every histogram that is kept
+*/
+void LazyHists::clear()
+{
+  for (map<string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) delete it->second.hist;
+  entries.clear();
+  bytes = 0;
+}
+
+
+/*
+  Returns the histogram key of the sample, reading it if it isn't kept
+  already (0 if the file doesn't have it)
+*/
+TH1* LazyHists::operator[](const string &key)
+{
+  map<string, Entry>::iterator found = entries.find(key);
+  if (found != entries.end())
+    {
+      found->second.lastUse = ++uses;
+      return found->second.hist;
+    }
+
+  TH1 *hist = prefetcher ? prefetcher->take(sample, key) : 0;
+  if (!hist && file)
+    {
+      hist = (TH1*)file->Get(key.c_str());
+      if (hist) hist->SetDirectory(0);     //So it is read again after it is deleted
+    }
+  if (!hist) return 0;
+
+  Entry entry = { hist, ++uses, bytesOf(hist) };
+  evict(entry.bytes);
+  entries[key] = entry;
+  bytes += entry.bytes;
+  return hist;
+}
+
+
+/*
+  Bytes of the bins of hist, from the type of its array (TH1F, TH2F, ...
+  are a TArrayF), and of its sums of squares, which are always doubles
+*/
+Long64_t LazyHists::bytesOf(const TH1 *hist)
+{
+  Long64_t cell = sizeof(Double_t);               //TH1D, TH2D, ...
+  if (dynamic_cast<const TArrayF*>(hist)) cell = sizeof(Float_t);
+  else if (dynamic_cast<const TArrayI*>(hist)) cell = sizeof(Int_t);
+  else if (dynamic_cast<const TArrayS*>(hist)) cell = sizeof(Short_t);
+  else if (dynamic_cast<const TArrayC*>(hist)) cell = sizeof(Char_t);
+  return cell*hist->GetNcells() + (Long64_t)sizeof(Double_t)*hist->GetSumw2N();
+}
+
+
+/*
+  Deletes the least recently used histograms until needed more bytes fit
+*/
+void LazyHists::evict(Long64_t needed)
+{
+  while (maxBytes > 0 && bytes + needed > maxBytes && !entries.empty())
+    {
+      map<string, Entry>::iterator oldest = entries.begin();
+      for (map<string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	if (it->second.lastUse < oldest->second.lastUse) oldest = it;
+
+      bytes -= oldest->second.bytes;
+      delete oldest->second.hist;
+      entries.erase(oldest);
+    }
+}
+
+
+HistPrefetcher::HistPrefetcher(const vector<string> &paths, const vector<string> &keys, int depth)
+  : paths(paths), keys(keys), depth(depth), loading(-1, -1), position(-1), stop(false)
+{
+  for (int k = 0; k < (int)keys.size(); ++k)
+    if (!keyIndex.count(keys[k])) keyIndex[keys[k]] = k;
+  thread = std::thread(&HistPrefetcher::run, this);
+}
+
+
+HistPrefetcher::~HistPrefetcher()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stop = true;
+  }
+  wake.notify_all();
+  thread.join();
+
+  for (map<std::pair<int, int>, TH1*>::iterator it = ready.begin(); it != ready.end(); ++it) delete it->second;
+}
+
+
+/*
+  Moves on to plotting the key keyIndex, and drops what was read for the
+  keys before it
+*/
+void HistPrefetcher::advance(int keyIndex)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    position = keyIndex;
+    while (!ready.empty() && ready.begin()->first.first < position)
+      {
+	delete ready.begin()->second;
+	ready.erase(ready.begin());
+      }
+  }
+  wake.notify_all();
+}
+
+
+/*
+  Returns the histogram key of sample if it was read already (waiting for
+  it if it is being read now), or else 0. The caller owns it.
+*/
+TH1* HistPrefetcher::take(int sample, const string &key)
+{
+  map<string, int>::const_iterator index = keyIndex.find(key);
+  if (index == keyIndex.end()) return 0;
+  std::pair<int, int> wanted(index->second, sample);
+
+  std::unique_lock<std::mutex> guard(lock);
+  while (loading == wanted) loaded.wait(guard);
+
+  map<std::pair<int, int>, TH1*>::iterator found = ready.find(wanted);
+  if (found == ready.end()) return 0;
+  TH1 *hist = found->second;
+  ready.erase(found);
+  return hist;
+}
+
+
+/*
+  The thread: reads every sample's histogram of the keys after position,
+  up to depth of them ahead. When the plots start again from an earlier
+  key (the next signal of plot_flags()), it starts again from there too.
+*/
+void HistPrefetcher::run()
+{
+  vector<TFile*> files(paths.size(), (TFile*)0);
+  int next = 0;                     //The next key to read
+  int seen = position;              //Where the plots were when next was last set
+
+  std::unique_lock<std::mutex> guard(lock);
+  while (!stop)
+    {
+      if (next <= position || position < seen) next = position + 1;
+      seen = position;
+      if (next >= (int)keys.size() || next > position + depth) { wake.wait(guard); continue; }
+
+      for (int s = 0; s < (int)paths.size() && !stop; ++s)
+	{
+	  if (next <= position) break;          //Passed while the others were read
+	  loading = std::make_pair(next, s);
+	  guard.unlock();
+
+	  if (!files[s]) files[s] = TFile::Open(paths[s].c_str(), "READ");
+	  TH1 *hist = files[s] ? (TH1*)files[s]->Get(keys[next].c_str()) : 0;
+	  if (hist) hist->SetDirectory(0);
+
+	  guard.lock();
+	  loading = std::make_pair(-1, -1);
+	  if (hist && next >= position && !ready.count(std::make_pair(next, s))) ready[std::make_pair(next, s)] = hist;
+	  else delete hist;
+	  loaded.notify_all();
+	}
+      ++next;
+    }
+  guard.unlock();
+
+  for (int s = 0; s < (int)files.size(); ++s) delete files[s];
+}
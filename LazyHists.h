@@ -0,0 +1,109 @@
+//////
+//These classes load the histograms of a make_plots sample from its file
+//only when they are used, instead of reading every key up front.
+//
+//LazyHists is the histograms map of a Hist: histograms[key] reads the
+//histogram from the file the first time it is asked for and keeps it,
+//detached from the file, until the histograms kept by the sample use more
+//than maxBytes (the size of a histogram is its bins, 4 bytes each for a
+//TH1F, 8 for a TH1D and so on, and 8 bytes for each sum of squares). Then
+//the ones that were used the longest ago are deleted, and read again from
+//the file if they are needed later. The one being read is never deleted,
+//and the plots use one key at a time, so maxBytes can be small; 0 keeps
+//everything. The histograms still kept are deleted with the LazyHists; a
+//copy starts out empty, so the two never delete the same ones.
+//
+//HistPrefetcher reads the next keys in a background thread while the
+//current canvas is drawn. It opens the files of the samples again for
+//itself (a TFile can't be read from two threads) and reads the "depth"
+//keys after the one that is being plotted, for every sample, and hands
+//them to LazyHists when they are asked for. advance() tells it which key
+//is being plotted; histograms of keys that were passed before they were
+//used are deleted. ROOT::EnableThreadSafety() has to be called before it
+//is started.
+//////
+
+#ifndef LAZYHISTS_H
+#define LAZYHISTS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "TFile.h"
+#include "TH1.h"
+using std::string;
+using std::vector;
+using std::map;
+
+class HistPrefetcher;
+
+
+class LazyHists
+{
+ public:
+  LazyHists() : file(0), prefetcher(0), sample(-1), maxBytes(0), bytes(0), uses(0) {}
+  LazyHists(const LazyHists &other);
+  LazyHists &operator=(const LazyHists &other);
+  ~LazyHists();
+
+  void attach(TFile *file_in, Long64_t maxBytes_in) { file = file_in; maxBytes = maxBytes_in; }
+  void setPrefetcher(HistPrefetcher *prefetcher_in, int sample_in) { prefetcher = prefetcher_in; sample = sample_in; }
+
+  TH1* operator[](const string &key);
+  Long64_t size() const { return bytes; }
+
+  static Long64_t bytesOf(const TH1 *hist);
+
+ private:
+  struct Entry
+  {
+    TH1 *hist;
+    Long64_t lastUse;
+    Long64_t bytes;
+  };
+
+  void evict(Long64_t needed);
+  void clear();
+
+  TFile *file;
+  HistPrefetcher *prefetcher;
+  int sample;                   //The index of the sample in the prefetcher
+  Long64_t maxBytes;
+  Long64_t bytes;
+  Long64_t uses;                //Counts the uses, for finding the least recently used
+  map<string, Entry> entries;
+};
+
+
+class HistPrefetcher
+{
+ public:
+  HistPrefetcher(const vector<string> &paths, const vector<string> &keys, int depth);
+  ~HistPrefetcher();
+
+  void advance(int keyIndex);
+  TH1* take(int sample, const string &key);
+
+ private:
+  void run();
+
+  vector<string> paths;         //The files of the samples
+  vector<string> keys;          //In the order they are plotted
+  map<string, int> keyIndex;
+  int depth;
+
+  std::mutex lock;
+  std::condition_variable wake;     //For the thread, when the plots move on or it has to stop
+  std::condition_variable loaded;   //For take(), when a histogram was read
+  map<std::pair<int, int>, TH1*> ready;     //By key index and sample
+  std::pair<int, int> loading;      //Being read now
+  int position;                     //The key being plotted
+  bool stop;
+  std::thread thread;
+};
+
+
+#endif /*LAZYHISTS_H*/
@@ -0,0 +1,183 @@
+//////
+//This class writes synthetic input files for dmcHist, so the event loop
+//can be tried and timed without access to the real ntuples on /eos/.
+//
+//Each file has a "nominal" tree with exactly the branches TreeConnector
+//connects to: the float weights (weight_mc, weight_pileup,
+//weight_leptonSF, weight_bTagSF_70, weight_trackjet_bTagSF_70 and
+//weight_jvt, left out for data) and the vector<float> branches jet_pt,
+//jet_eta, jet_phi, ljet_pt, ljet_eta, ljet_phi and ljet_m. The energies
+//are in MeV like the real ntuples:
+//
+//  small jets  Poisson(nJets) of them, Pt above 25 GeV falling
+//              exponentially, |eta| < 2.5
+//  large jets  Poisson(nLjets) of them, Pt above 200 GeV, |eta| < 2.0,
+//              mass around 120 GeV; the second one is roughly back to
+//              back with the first in phi
+//  weights     close to 1, with a few negative weight_mc like NLO samples
+//
+//The jets of every event are in decreasing Pt, as in the ntuples. The
+//production files also have hundreds of branches dmcHist never reads;
+//nExtra vector<float> branches (extra_0, extra_1, ...) with one value per
+//small jet stand in for them, so switching branches off and the
+//TTreeCache matter as much as they do on the real files.
+//
+//The random numbers come from a generator seeded with seed, so the same
+//settings always give the same events.
+//////
+
+#ifndef NTUPLEGENERATOR_H
+#define NTUPLEGENERATOR_H
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <sstream>
+#include "TFile.h"
+#include "TTree.h"
+#include "TString.h"
+using std::vector;
+
+
+class NtupleGenerator
+{
+ public:
+  NtupleGenerator();
+
+  bool write(const TString &path, Long64_t nEvents, unsigned seed);
+
+  bool isData;
+  double nJets;                 //Mean number of small jets
+  double nLjets;                //Mean number of large jets
+  int nExtra;                   //Unread vector<float> branches
+  int compression;              //ROOT compression settings, e.g. 101 (zlib 1) or 207 (lzma 7)
+  Long64_t autoFlush;           //TTree::SetAutoFlush, negative for bytes
+
+ private:
+  void makeEvent(std::mt19937 &random);
+
+  Float_t weight_mc, weight_pileup, weight_leptonSF, weight_bTagSF_70, weight_trackjet_bTagSF_70, weight_jvt;
+  vector<float> jet_pt, jet_eta, jet_phi;
+  vector<float> ljet_pt, ljet_eta, ljet_phi, ljet_m;
+  vector<vector<float> > extra;
+};
+
+
+NtupleGenerator::NtupleGenerator()
+  : isData(false), nJets(6), nLjets(1.6), nExtra(20), compression(101), autoFlush(-30000000)
+{
+}
+
+
+/*
+  Writes nEvents events into a new file at path. Returns false if the file
+  couldn't be made.
+*/
+bool NtupleGenerator::write(const TString &path, Long64_t nEvents, unsigned seed)
+{
+  TFile *f = TFile::Open(path, "RECREATE");
+  if (!f || f->IsZombie()) { delete f; return false; }
+  f->SetCompressionSettings(compression);
+
+  TTree *tree = new TTree("nominal", "nominal");
+  tree->SetAutoFlush(autoFlush);
+
+  if (!isData)
+    {
+      tree->Branch("weight_mc", &weight_mc, "weight_mc/F");
+      tree->Branch("weight_pileup", &weight_pileup, "weight_pileup/F");
+      tree->Branch("weight_leptonSF", &weight_leptonSF, "weight_leptonSF/F");
+      tree->Branch("weight_bTagSF_70", &weight_bTagSF_70, "weight_bTagSF_70/F");
+      tree->Branch("weight_trackjet_bTagSF_70", &weight_trackjet_bTagSF_70, "weight_trackjet_bTagSF_70/F");
+      tree->Branch("weight_jvt", &weight_jvt, "weight_jvt/F");
+    }
+
+  vector<float> *jetBranches[3] = { &jet_pt, &jet_eta, &jet_phi };
+  const char *jetNames[3] = { "jet_pt", "jet_eta", "jet_phi" };
+  for (int b = 0; b < 3; ++b) tree->Branch(jetNames[b], jetBranches[b]);
+
+  vector<float> *ljetBranches[4] = { &ljet_pt, &ljet_eta, &ljet_phi, &ljet_m };
+  const char *ljetNames[4] = { "ljet_pt", "ljet_eta", "ljet_phi", "ljet_m" };
+  for (int b = 0; b < 4; ++b) tree->Branch(ljetNames[b], ljetBranches[b]);
+
+  extra.assign(nExtra, vector<float>());
+  for (int b = 0; b < nExtra; ++b)
+    {
+      std::stringstream name;
+      name << "extra_" << b;
+      tree->Branch(name.str().c_str(), &extra[b]);
+    }
+
+  std::mt19937 random(seed);
+  for (Long64_t j = 0; j < nEvents; ++j)
+    {
+      makeEvent(random);
+      tree->Fill();
+    }
+
+  f->cd();
+  tree->Write();
+  f->Close();
+  delete f;
+  return true;
+}
+
+
+/*
+  Makes the jets and weights of one event
+*/
+void NtupleGenerator::makeEvent(std::mt19937 &random)
+{
+  const float pi = 3.14159265358979f;
+  std::uniform_real_distribution<float> uniform(0, 1);
+  std::normal_distribution<float> gauss(0, 1);
+  std::poisson_distribution<int> jetCount(nJets), ljetCount(nLjets);
+  std::exponential_distribution<float> jetFall(1/40e3f), ljetFall(1/150e3f);
+
+  int nj = jetCount(random), nl = ljetCount(random);
+
+  jet_pt.resize(nj); jet_eta.resize(nj); jet_phi.resize(nj);
+  for (int j = 0; j < nj; ++j) jet_pt[j] = 25e3f + jetFall(random);
+  std::sort(jet_pt.begin(), jet_pt.end(), std::greater<float>());
+  for (int j = 0; j < nj; ++j)
+    {
+      jet_eta[j] = 5*uniform(random) - 2.5f;
+      jet_phi[j] = 2*pi*uniform(random) - pi;
+    }
+
+  ljet_pt.resize(nl); ljet_eta.resize(nl); ljet_phi.resize(nl); ljet_m.resize(nl);
+  for (int l = 0; l < nl; ++l) ljet_pt[l] = 200e3f + ljetFall(random);
+  std::sort(ljet_pt.begin(), ljet_pt.end(), std::greater<float>());
+  for (int l = 0; l < nl; ++l)
+    {
+      ljet_eta[l] = 4*uniform(random) - 2.0f;
+      ljet_phi[l] = 2*pi*uniform(random) - pi;
+      if (l == 1)                                   //Roughly back to back with the leading one
+	{
+	  ljet_phi[1] = ljet_phi[0] + pi + 0.3f*gauss(random);
+	  if (ljet_phi[1] > pi) ljet_phi[1] -= 2*pi;
+	}
+      ljet_m[l] = std::fabs(120e3f + 50e3f*gauss(random));
+    }
+
+  for (int b = 0; b < nExtra; ++b)
+    {
+      extra[b].resize(nj);
+      for (int j = 0; j < nj; ++j) extra[b][j] = uniform(random);
+    }
+
+  if (isData) return;
+  weight_mc = (uniform(random) < 0.05f ? -1 : 1) * (1 + 0.1f*gauss(random));
+  weight_pileup = 1 + 0.2f*gauss(random);
+  weight_leptonSF = 1 + 0.02f*gauss(random);
+  weight_bTagSF_70 = 1 + 0.05f*gauss(random);
+  weight_trackjet_bTagSF_70 = 1 + 0.05f*gauss(random);
+  weight_jvt = 1 + 0.01f*gauss(random);
+}
+
+
+
+#endif /*NTUPLEGENERATOR_H*/
@@ -0,0 +1,214 @@
+//////
+//These classes fill the histograms of several regions and several weight
+//variations in one pass over the events, instead of running dmcHist once
+//for each.
+//
+//A region is a name and a cut (see EventSelection.h), given to dmcHist as
+//"--region SR=ljet_pt[0] > 500e3". The names of the regions, and the
+//factors dropped, can't repeat. For every event the cuts of all the
+//regions are evaluated once into a bit mask, and the event is filled into
+//every region whose bit is set. Without any regions there is one region,
+//"all", that every event is in.
+//
+//A weight variation is the nominal weight (weight_mc * weight_pileup *
+//weight_leptonSF * weight_jvt) with one factor left out, given as
+//"--drop-weight weight_pileup" (named "no_weight_pileup"). "nominal" is
+//always made. Data events have weight 1 in every variation.
+//
+//Every (region, variation) pair is a slot with its own set of histograms,
+//saved in the directory region/variation. The slots are numbered
+//region * nVariations + variation. RegionFiller fills the sets of all the
+//slots from one event.
+//////
+
+#ifndef REGIONSET_H
+#define REGIONSET_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <stdint.h>
+#include "TreeConnector.h"
+#include "EventSelection.h"
+using std::vector;
+
+
+class RegionSet
+{
+ public:
+  static const int maxRegions = 64;       //Bits in the mask
+  static const int nFactors = 4;          //Factors of the nominal weight
+
+  RegionSet(const vector<std::string> &regionArgs, const vector<std::string> &dropWeights);
+
+  int nRegions() const { return regionNames.size(); }
+  int nVariations() const { return variationNames.size(); }
+  int nSlots() const { return nRegions() * nVariations(); }
+  const std::string &regionName(int slot) const { return regionNames[slot / nVariations()]; }
+  const std::string &variationName(int slot) const { return variationNames[slot % nVariations()]; }
+
+  void check(const TreeConnector &tc) const;
+  uint64_t mask(const TreeConnector &tc) const;
+  void weights(TreeConnector &tc, vector<Float_t> &w) const;
+
+ private:
+  vector<std::string> regionNames;
+  vector<CutExpression> regionCuts;
+  vector<std::string> variationNames;
+  vector<int> dropped;                    //Factor each variation leaves out (-1 for nominal)
+};
+
+
+template <class Hists>
+class RegionFiller
+{
+ public:
+  RegionFiller(const RegionSet &regions, const vector<Hists*> &slots);
+
+  void fill(TreeConnector &tc, Float_t totalWeight);
+  void fillBatch(const EventBatch &batch);
+  void flush();
+
+ private:
+  const RegionSet &regions;
+  vector<Hists*> slots;
+  vector<Float_t> w;
+};
+
+
+/*
+  Reads the regions ("NAME=CUT") and the factors to drop from the weight.
+  Throws std::invalid_argument if one isn't valid.
+*/
+RegionSet::RegionSet(const vector<std::string> &regionArgs, const vector<std::string> &dropWeights)
+{
+  static const char *factors[nFactors] = { "weight_mc", "weight_pileup", "weight_leptonSF", "weight_jvt" };
+
+  for (size_t r = 0; r < regionArgs.size(); ++r)
+    {
+      size_t eq = regionArgs[r].find('=');
+      if (eq == std::string::npos || eq == 0 || regionArgs[r].find('/') < eq)
+	throw std::invalid_argument("Region \"" + regionArgs[r] + "\" should be NAME=CUT");
+      for (size_t p = 0; p < regionNames.size(); ++p)
+	if (regionNames[p] == regionArgs[r].substr(0, eq)) throw std::invalid_argument("Region " + regionNames[p] + " is given twice");
+      regionNames.push_back(regionArgs[r].substr(0, eq));
+      regionCuts.push_back(CutExpression(regionArgs[r].substr(eq+1)));
+    }
+  if (regionNames.empty())
+    {
+      regionNames.push_back("all");
+      regionCuts.push_back(CutExpression("1"));
+    }
+  if ((int)regionNames.size() > maxRegions) throw std::invalid_argument("Too many regions");
+
+  variationNames.push_back("nominal");
+  dropped.push_back(-1);
+  for (size_t d = 0; d < dropWeights.size(); ++d)
+    {
+      int f = 0;
+      while (f < nFactors && dropWeights[d] != factors[f]) ++f;
+      if (f == nFactors) throw std::invalid_argument("--drop-weight " + dropWeights[d] + " isn't one of the factors of the weight");
+      for (size_t p = 0; p < dropped.size(); ++p)
+	if (dropped[p] == f) throw std::invalid_argument("--drop-weight " + dropWeights[d] + " is given twice");
+      variationNames.push_back("no_" + dropWeights[d]);
+      dropped.push_back(f);
+    }
+}
+
+
+/*
+  Throws std::invalid_argument if the cut of a region needs a branch tc
+  doesn't read (the weights of data), like EventSelection::connect()
+*/
+void RegionSet::check(const TreeConnector &tc) const
+{
+  for (int r = 0; r < nRegions(); ++r)
+    for (size_t b = 0; b < regionCuts[r].branches.size(); ++b)
+      {
+	bool read = false;
+	for (size_t n = 0; n < tc.branchesRead.size(); ++n) read = read || tc.branchesRead[n] == regionCuts[r].branches[b].c_str();
+	if (!read) throw std::invalid_argument("Region " + regionNames[r] + " uses " + regionCuts[r].branches[b] + ", which isn't read for this file");
+      }
+}
+
+
+/*
+  Bit r is set if the event loaded in tc is in region r
+*/
+uint64_t RegionSet::mask(const TreeConnector &tc) const
+{
+  uint64_t bits = 0;
+  for (int r = 0; r < nRegions(); ++r)
+    if (regionCuts[r].pass(tc)) bits |= uint64_t(1) << r;
+  return bits;
+}
+
+
+/*
+  Weight of the event loaded in tc in every variation. The factors are
+  multiplied in the same order as the nominal weight everywhere else, so
+  "nominal" is exactly the usual weight.
+*/
+void RegionSet::weights(TreeConnector &tc, vector<Float_t> &w) const
+{
+  w.assign(nVariations(), 1.0);
+  if (tc.isData()) return;
+
+  Float_t f[nFactors] = { tc.weight_mc, tc.weight_pileup, tc.weight_leptonSF, tc.weight_jvt };
+  for (int v = 0; v < nVariations(); ++v)
+    {
+      bool first = true;
+      for (int k = 0; k < nFactors; ++k)
+	{
+	  if (k == dropped[v]) continue;
+	  w[v] = first ? f[k] : w[v]*f[k];
+	  first = false;
+	}
+    }
+}
+
+
+template <class Hists>
+RegionFiller<Hists>::RegionFiller(const RegionSet &regions_in, const vector<Hists*> &slots_in)
+  : regions(regions_in), slots(slots_in)
+{
+}
+
+
+/*
+  Fills the event loaded in tc into every variation of every region it is
+  in. totalWeight isn't used, every variation works out its own.
+*/
+template <class Hists>
+void RegionFiller<Hists>::fill(TreeConnector &tc, Float_t)
+{
+  uint64_t bits = regions.mask(tc);
+  if (!bits) return;
+
+  regions.weights(tc, w);
+  int nv = regions.nVariations();
+  for (int r = 0; r < regions.nRegions(); ++r)
+    if (bits & (uint64_t(1) << r))
+      for (int v = 0; v < nv; ++v) slots[r*nv + v]->fill(tc, w[v]);
+}
+
+
+/*
+  Batches only have the nominal weight, so they can't be used here
+*/
+template <class Hists>
+void RegionFiller<Hists>::fillBatch(const EventBatch &)
+{
+  throw std::logic_error("RegionFiller::fillBatch: regions are filled event by event");
+}
+
+
+template <class Hists>
+void RegionFiller<Hists>::flush()
+{
+  for (size_t s = 0; s < slots.size(); ++s) slots[s]->flush();
+}
+
+
+
+#endif /*REGIONSET_H*/
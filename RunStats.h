@@ -0,0 +1,270 @@
+//////
+//These classes record where the time of a dmcHist run goes, and save it
+//as a JSON report next to the histograms (<sample>.stats.json).
+//
+//The time is split into stages:
+//
+//  open        TFile::Open of the input files
+//  getTree     finding the nominal tree and connecting its branches
+//  read        GetEntry (or readBatch) and the cuts, without decompressing
+//  decompress  unzipping the baskets (from ROOT's TTreePerfStats)
+//  fill        filling the histograms
+//  write       saving the histograms
+//
+//Each thread keeps its own StageClock, so the probes in the event loop
+//never lock or share a cache line; lap() reads the clock once and adds
+//the time since the last lap to a stage. The clocks are added into the
+//RunStats when the threads finish. The times of the stages are summed
+//over the threads, so with several threads they add up to more than the
+//wall time. For every file the entries read, the bytes read and the time
+//spent on it are kept too.
+//
+//TTreePerfStats goes through ROOT's global gPerfStats, so decompress is
+//only split out of read when there is one thread and no prefetching;
+//otherwise it is included in read and reported as null.
+//
+//Every probe in dmcHist is written inside STATS(...). Building with
+//-DDMC_NO_STATS ("make NOSTATS=1") makes STATS(...) expand to nothing, so
+//the probes are compiled out entirely and no report is written.
+//////
+
+#ifndef RUNSTATS_H
+#define RUNSTATS_H
+
+#ifndef DMC_NO_STATS
+#define STATS(...) __VA_ARGS__
+#else
+#define STATS(...)
+#endif
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include "TTree.h"
+#include "TString.h"
+#include "TTreePerfStats.h"
+using std::vector;
+
+
+class StageClock
+{
+ public:
+  enum Stage { kOpen, kGetTree, kRead, kDecompress, kFill, kWrite, kNStages };
+
+  StageClock() : last(now()), perfStats(0) { for (int s = 0; s < kNStages; ++s) ticks[s] = 0; }
+  ~StageClock() { unwatch(); }
+
+  void start() { last = now(); }
+  void lap(Stage stage) { Long64_t t = now(); ticks[stage] += t - last; last = t; }
+  double seconds(Stage stage) const { return ticks[stage]*1e-9; }
+
+  void watch(TTree *tree);
+  void unwatch();
+
+  static Long64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  Long64_t ticks[kNStages];     //Nanoseconds spent on every stage
+
+ private:
+  Long64_t last;
+  TTreePerfStats *perfStats;    //Only while a tree is watched
+};
+
+
+class RunStats
+{
+ public:
+  RunStats(const vector<TString> &files, bool splitDecompress);
+
+  void add(const StageClock &clock);
+  void fileOpened(int fileNum, double openSeconds, double treeSeconds);
+  void fileSkipped(int fileNum);
+  void addRange(int fileNum, Long64_t entries, double seconds);
+  void setBytes(int fileNum, Long64_t bytesRead, Long64_t fileBytes);
+  void addWrite(double seconds) { total.ticks[StageClock::kWrite] += (Long64_t)(seconds*1e9); }
+
+  bool write(const std::string &path, const std::string &sample, int nThreads, const std::string &mode, double wallSeconds) const;
+
+ private:
+  enum Status { kNotRead, kRead, kSkipped };
+
+  struct FileStats
+  {
+    Status status;
+    Long64_t entries;
+    Long64_t bytesRead, fileBytes;
+    double openSeconds;
+    double seconds;             //Reading, decompressing and filling, over all of its ranges
+  };
+
+  static std::string quote(const TString &text);
+
+  vector<TString> paths;
+  vector<FileStats> fileStats;
+  StageClock total;
+  bool splitDecompress;
+  mutable std::mutex lock;
+};
+
+
+/*
+  Starts measuring the decompression of the baskets of tree
+*/
+void StageClock::watch(TTree *tree)
+{
+  unwatch();
+  perfStats = new TTreePerfStats("dmcHistIO", tree);
+}
+
+
+/*
+  Moves the decompression time of the watched tree from read to decompress
+*/
+void StageClock::unwatch()
+{
+  if (!perfStats) return;
+  Long64_t unzip = (Long64_t)(perfStats->GetUnzipTime()*1e9);
+  ticks[kRead] -= unzip;
+  ticks[kDecompress] += unzip;
+  delete perfStats;
+  perfStats = 0;
+}
+
+
+RunStats::RunStats(const vector<TString> &files, bool splitDecompress)
+  : paths(files), splitDecompress(splitDecompress)
+{
+  FileStats empty = { kNotRead, 0, 0, 0, 0, 0 };
+  fileStats.assign(files.size(), empty);
+}
+
+
+/*
+  Adds the stages of one thread's clock
+*/
+void RunStats::add(const StageClock &clock)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  for (int s = 0; s < StageClock::kNStages; ++s) total.ticks[s] += clock.ticks[s];
+}
+
+
+/*
+  Records the opening of a file (this can be on any thread)
+*/
+void RunStats::fileOpened(int fileNum, double openSeconds, double treeSeconds)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  fileStats[fileNum].status = kRead;
+  fileStats[fileNum].openSeconds += openSeconds;
+  total.ticks[StageClock::kOpen] += (Long64_t)(openSeconds*1e9);
+  total.ticks[StageClock::kGetTree] += (Long64_t)(treeSeconds*1e9);
+}
+
+
+void RunStats::fileSkipped(int fileNum)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  fileStats[fileNum].status = kSkipped;
+}
+
+
+/*
+  Records a range of entries of a file that was read and filled
+*/
+void RunStats::addRange(int fileNum, Long64_t entries, double seconds)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  fileStats[fileNum].entries += entries;
+  fileStats[fileNum].seconds += seconds;
+}
+
+
+void RunStats::setBytes(int fileNum, Long64_t bytesRead, Long64_t fileBytes)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  fileStats[fileNum].bytesRead = bytesRead;
+  fileStats[fileNum].fileBytes = fileBytes;
+}
+
+
+/*
+  Puts text in quotes for JSON
+*/
+std::string RunStats::quote(const TString &text)
+{
+  std::string quoted("\"");
+  for (int i = 0; i < text.Length(); ++i)
+    {
+      char c = text[i];
+      if (c == '"' || c == '\\') quoted += '\\';
+      if ((unsigned char)c >= 0x20) quoted += c;
+    }
+  return quoted + "\"";
+}
+
+
+/*
+  Writes the report. Returns false if the file couldn't be written.
+*/
+bool RunStats::write(const std::string &path, const std::string &sample, int nThreads, const std::string &mode, double wallSeconds) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  std::ofstream str(path.c_str());
+  if (str.fail()) return false;
+
+  int nRead = 0, nSkipped = 0;
+  Long64_t entries = 0, bytesRead = 0;
+  for (int i = 0; i < (int)fileStats.size(); ++i)
+    {
+      if (fileStats[i].status == kRead) ++nRead;
+      if (fileStats[i].status == kSkipped) ++nSkipped;
+      entries += fileStats[i].entries;
+      bytesRead += fileStats[i].bytesRead;
+    }
+
+  const char *stageNames[StageClock::kNStages] = { "open", "get_tree", "read", "decompress", "fill", "write" };
+
+  str << "{" << std::endl
+      << "  \"sample\": " << quote(sample.c_str()) << "," << std::endl
+      << "  \"threads\": " << nThreads << "," << std::endl
+      << "  \"mode\": " << quote(mode.c_str()) << "," << std::endl
+      << "  \"wall_seconds\": " << wallSeconds << "," << std::endl
+      << "  \"files\": {\"total\": " << fileStats.size() << ", \"opened\": " << nRead << ", \"skipped\": " << nSkipped
+      << ", \"not_read\": " << fileStats.size() - nRead - nSkipped << "}," << std::endl
+      << "  \"entries\": " << entries << "," << std::endl
+      << "  \"events_per_s\": " << (wallSeconds > 0 ? entries/wallSeconds : 0) << "," << std::endl
+      << "  \"bytes_read\": " << bytesRead << "," << std::endl
+      << "  \"mb_per_s\": " << (wallSeconds > 0 ? bytesRead/wallSeconds/1e6 : 0) << "," << std::endl
+      << "  \"stage_seconds\": {";
+  for (int s = 0; s < StageClock::kNStages; ++s)
+    {
+      str << (s ? ", " : "") << "\"" << stageNames[s] << "\": ";
+      if (s == StageClock::kDecompress && !splitDecompress) str << "null";
+      else str << total.seconds((StageClock::Stage)s);
+    }
+  str << "}," << std::endl
+      << "  \"per_file\": [";
+
+  const char *statusNames[3] = { "not read", "read", "skipped" };
+  for (int i = 0; i < (int)fileStats.size(); ++i)
+    {
+      const FileStats &fs = fileStats[i];
+      str << (i ? "," : "") << std::endl
+	  << "    {\"file\": " << i+1 << ", \"path\": " << quote(paths[i]) << ", \"status\": \"" << statusNames[fs.status] << "\""
+	  << ", \"entries\": " << fs.entries << ", \"bytes_read\": " << fs.bytesRead << ", \"file_bytes\": " << fs.fileBytes
+	  << ", \"open_seconds\": " << fs.openSeconds << ", \"seconds\": " << fs.seconds
+	  << ", \"events_per_s\": " << (fs.seconds > 0 ? fs.entries/fs.seconds : 0) << "}";
+    }
+  str << std::endl << "  ]" << std::endl << "}" << std::endl;
+  return !str.fail();
+}
+
+
+
+#endif /*RUNSTATS_H*/
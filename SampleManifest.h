@@ -0,0 +1,150 @@
+//////
+//These functions read the text files that tell dmcHist which files to use.
+//
+//A file list (like ttbar.txt) has the full path to one input root file on
+//every line. A sample manifest lists several samples so they can all be
+//made in one run, one sample per line:
+//
+//  # name       file list          type   color   group
+//  data         data_15_16.txt     data   1       Data
+//  ttbar        ttbar.txt          mc     44      Signal
+//  background   background.txt     mc     38      Background
+//
+//The file lists are found in the same directory as the manifest. Blank
+//lines and lines starting with # are skipped. The type says if the sample
+//is data (no weights) or mc, instead of guessing from the file names.
+//
+//For batch jobs the files can be split into shards: selectShard() keeps
+//every nShards-th file of all the samples together, starting at file
+//shard, so each job of an array reads its own part of every sample and
+//writes it to a file named with shardTag() (dmcMerge adds them up). The
+//other files a job writes get the tag too, with shardPath(), so the jobs
+//never write to the same file.
+//////
+
+#ifndef SAMPLEMANIFEST_H
+#define SAMPLEMANIFEST_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "TString.h"
+using std::vector;
+
+
+struct Sample
+{
+  std::string name;             //Name of the histogram directory (or file) for this sample
+  std::string listFile;         //Text file with the paths to the input files
+  bool isData;
+  int color;
+  std::string group;            //Legend entry, e.g. "Signal"
+  vector<TString> files;
+};
+
+
+/*
+  Reads the paths in a file list into files. Returns false if the list
+  couldn't be opened or was empty.
+*/
+bool readFileList(const std::string &path, vector<TString> &files)
+{
+  std::ifstream str(path.c_str());
+  if (str.fail()) { std::cout << path << " could not be opened!" << std::endl; return false; }
+
+  std::string temp;
+  while (getline(str, temp))
+    {
+      if (temp.size() == 0) continue;     // This is to skip blank lines
+
+      files.push_back((TString)temp);
+    }
+  if (files.size() == 0) { std::cout << path << " was empty!" << std::endl; return false; }
+
+  return true;
+}
+
+
+/*
+  Reads a sample manifest and the file list of every sample in it
+*/
+bool readManifest(const std::string &dir, const std::string &manifestName, vector<Sample> &samples)
+{
+  std::ifstream str((dir+manifestName).c_str());
+  if (str.fail()) { std::cout << manifestName << " could not be opened!" << std::endl; return false; }
+
+  std::string line;
+  int lineNum = 0;
+  while (getline(str, line))
+    {
+      ++lineNum;
+      std::stringstream ss(line);
+      std::string type;
+      Sample s;
+
+      if (!(ss >> s.name) || s.name[0] == '#') continue;
+
+      if (!(ss >> s.listFile >> type >> s.color) || (type != "data" && type != "mc"))
+	{
+	  std::cout << manifestName << " line " << lineNum << " should be: name fileList data|mc color [group]" << std::endl;
+	  return false;
+	}
+      s.isData = (type == "data");
+
+      getline(ss >> std::ws, s.group);
+      if (s.group.empty()) s.group = s.name;
+
+      if (!readFileList(dir+s.listFile, s.files)) return false;
+      samples.push_back(s);
+    }
+  if (samples.size() == 0) { std::cout << manifestName << " has no samples!" << std::endl; return false; }
+
+  return true;
+}
+
+
+/*
+  Keeps only the files of shard (0 to nShards-1). The files of all the
+  samples are counted in order, so the split only depends on the lists.
+*/
+void selectShard(vector<Sample> &samples, int shard, int nShards)
+{
+  int n = 0;
+  for (int s = 0; s < (int)samples.size(); ++s)
+    {
+      vector<TString> kept;
+      for (int i = 0; i < (int)samples[s].files.size(); ++i, ++n)
+	if (n % nShards == shard) kept.push_back(samples[s].files[i]);
+      samples[s].files.swap(kept);
+    }
+}
+
+
+/*
+  What is added to the name of the output file of a shard, e.g. ".shard2of8"
+*/
+std::string shardTag(int shard, int nShards)
+{
+  std::stringstream tag;
+  tag << ".shard" << shard << "of" << nShards;
+  return tag.str();
+}
+
+
+/*
+  path with the shard tag put before its extension, e.g. plan.txt becomes
+  plan.shard2of8.txt
+*/
+std::string shardPath(const std::string &path, int shard, int nShards)
+{
+  size_t dot = path.find_last_of('.');
+  size_t slash = path.find_last_of('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+  return path.substr(0, dot) + shardTag(shard, nShards) + path.substr(dot);
+}
+
+
+
+#endif /*SAMPLEMANIFEST_H*/
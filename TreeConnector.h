@@ -5,6 +5,20 @@
 //make a TreeConnector object, check if the input file is data or not, and 
 //then initialize the connections with init(TTree*). This way, it is easy to
 //loop through many files and connect each time.
+//
+//init() switches off every branch of the tree and only switches back on
+//the ones it connects to (their names are kept in branchesRead), so ROOT
+//never reads the hundreds of other branches in the production ntuples.
+//To read another branch, uncomment its connect() line in init().
+//
+//Instead of calling GetEntry on the tree for every event, readBatch() can
+//be used to read a block of events one branch at a time into an
+//EventBatch, where every branch is a single contiguous array of floats
+//(vector branches get an offsets array saying where each event starts).
+//No GetEntry is called for each event: the four weights are read a
+//basket at a time with the bulk API of TBranch (GetBulkRead()), and the
+//baskets of the vector<float> jet branches, which the bulk API can't read,
+//are decoded here straight into the columns.
 //////
 
 #ifndef TREECONNECTOR_H
@@ -12,11 +26,33 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
 #include "TTree.h"
 #include "TFile.h"
+#include "TBranch.h"
+#include "TBufferFile.h"
+#include "TBasket.h"
+#include "TMath.h"
+#include "Bytes.h"
 using std::vector;
 
 
+struct EventBatch
+{
+  Long64_t first;                 //Entry number of the first event in the batch
+  Long64_t nEvents;
+
+  vector<Float_t> weight;         //weight_mc*weight_pileup*weight_leptonSF*weight_jvt, 1 for data
+
+  vector<int> jet_offsets;        //Event i has the small jets [jet_offsets[i], jet_offsets[i+1])
+  vector<Float_t> jet_pt, jet_eta, jet_phi;
+
+  vector<int> ljet_offsets;       //Event i has the large jets [ljet_offsets[i], ljet_offsets[i+1])
+  vector<Float_t> ljet_pt, ljet_eta, ljet_phi, ljet_m;
+};
+
+
 class TreeConnector
 {
  private:
@@ -28,10 +64,15 @@ class TreeConnector
   void setAsMC();
   bool isData();
   void getTree(TFile *file, TTree *&tree, TString searchTerm);
+  void readBatch(Long64_t first, Long64_t last, EventBatch &batch);
+  void setupCache(Long64_t bytes);
 
   // Tree you are connecting to
   TTree *cTree;
 
+  // Names of the branches that init() connected, all others are switched off
+  vector<TString> branchesRead;
+
   // Declaration of leaf types
   Float_t         weight_mc;
   Float_t         weight_pileup;
@@ -97,11 +138,17 @@ class TreeConnector
   TBranch        *b_ljet_sd12;   //!
 
   //TBranch        *b_met_met;   //!
+
+ private:
+  template <class T> void connect(const char *name, T *address, TBranch **branch);
+  void readFlat(TBranch *branch, Float_t &leaf, Long64_t first, Long64_t last, vector<Float_t> &column, bool multiply, TBufferFile &buffer);
+  void readJagged(TBranch *branch, vector<float> *&leaf, Long64_t first, Long64_t last, vector<Float_t> &column, vector<int> *offsets);
 };
 
 
 /*
   Returns a pointer to the tree with a name that contains the searchTerm
+  (tree is left 0 if there isn't one, for the caller to deal with)
 */
 void TreeConnector::getTree(TFile *file, TTree *&tree, TString searchTerm)
 {
@@ -117,10 +164,153 @@ void TreeConnector::getTree(TFile *file, TTree *&tree, TString searchTerm)
     
   if (!tree) //Keep this error check
     {
-      std::cout << "ABORTING ACTION" << std::endl
-		<< "The tree was not found in the file!" << std::endl;
-      exit(0); 
+      std::cout << "The tree was not found in the file!" << std::endl;
+    }
+}
+
+/*
+  Reads the entries [first, last) into batch, one branch at a time. The
+  weights are multiplied in the same order as the per event loop in dmcHist
+  does it, so the batch gives exactly the same numbers as GetEntry.
+*/
+void TreeConnector::readBatch(Long64_t first, Long64_t last, EventBatch &batch)
+{
+  batch.first = first;
+  batch.nEvents = last - first;
+
+  if (fileIsData) batch.weight.assign(batch.nEvents, 1.0);
+  else
+    {
+      TBufferFile buffer(TBuffer::kWrite, 32000);     //Baskets of the weights, for the bulk reads
+      readFlat(b_weight_mc,     weight_mc,     first, last, batch.weight, false, buffer);
+      readFlat(b_weight_pileup, weight_pileup, first, last, batch.weight, true,  buffer);
+      readFlat(b_weight_leptonSF, weight_leptonSF, first, last, batch.weight, true, buffer);
+      readFlat(b_weight_jvt,    weight_jvt,    first, last, batch.weight, true,  buffer);
     }
+
+  readJagged(b_jet_pt,  jet_pt,  first, last, batch.jet_pt,  &batch.jet_offsets);
+  readJagged(b_jet_eta, jet_eta, first, last, batch.jet_eta, 0);
+  readJagged(b_jet_phi, jet_phi, first, last, batch.jet_phi, 0);
+
+  readJagged(b_ljet_pt,  ljet_pt,  first, last, batch.ljet_pt,  &batch.ljet_offsets);
+  readJagged(b_ljet_eta, ljet_eta, first, last, batch.ljet_eta, 0);
+  readJagged(b_ljet_phi, ljet_phi, first, last, batch.ljet_phi, 0);
+  readJagged(b_ljet_m,   ljet_m,   first, last, batch.ljet_m,   0);
+
+  if (batch.jet_eta.size() != batch.jet_pt.size() || batch.jet_phi.size() != batch.jet_pt.size()
+      || batch.ljet_eta.size() != batch.ljet_pt.size() || batch.ljet_phi.size() != batch.ljet_pt.size()
+      || batch.ljet_m.size() != batch.ljet_pt.size())
+    throw std::out_of_range("TreeConnector::readBatch: jet branches have different lengths");
+}
+
+/*
+  Reads a float branch for every entry of [first, last) into column, or
+  multiplies column by it. The baskets are read whole with the bulk API,
+  from their first entry (where it starts them), into buffer; if the branch
+  can't be read that way, the rest is read with GetEntry into leaf.
+*/
+void TreeConnector::readFlat(TBranch *branch, Float_t &leaf, Long64_t first, Long64_t last, vector<Float_t> &column, bool multiply,
+			     TBufferFile &buffer)
+{
+  if (!multiply) column.resize(last - first);
+
+  Long64_t j = first;
+  while (j < last)
+    {
+      Long64_t *basketEntry = branch->GetBasketEntry();
+      Long64_t basketFirst = basketEntry[TMath::BinarySearch((Long64_t)branch->GetWriteBasket()+1, basketEntry, j)];
+      Int_t n = branch->GetBulkRead().GetEntriesSerialized(basketFirst, buffer);
+      if (n <= j - basketFirst) break;
+
+      char *value = buffer.GetCurrent() + (j - basketFirst)*sizeof(Float_t);
+      for (Long64_t end = std::min(last, basketFirst + n); j < end; ++j)
+	{
+	  Float_t x;
+	  frombuf(value, &x);                  //Big endian in the basket
+	  if (multiply) column[j - first] *= x;
+	  else column[j - first] = x;
+	}
+    }
+
+  for (; j < last; ++j)
+    {
+      branch->GetEntry(j);
+      if (multiply) column[j - first] *= leaf;
+      else column[j - first] = leaf;
+    }
+}
+
+/*
+  Appends a vector<float> branch for every entry of [first, last) to one
+  flat column, and records where every entry starts in offsets (if given).
+  The baskets are decoded directly: the basket keeps where every entry
+  starts, and an entry is a byte count and a version (6 bytes), the number
+  of floats and the floats, all big endian. If a basket doesn't look like
+  that, the rest is read with GetEntry into leaf.
+*/
+void TreeConnector::readJagged(TBranch *branch, vector<float> *&leaf, Long64_t first, Long64_t last, vector<Float_t> &column, vector<int> *offsets)
+{
+  column.clear();
+  if (offsets) { offsets->clear(); offsets->reserve(last - first + 1); }
+
+  Long64_t j = first;
+  while (j < last)
+    {
+      Long64_t *basketEntry = branch->GetBasketEntry();
+      Int_t b = TMath::BinarySearch((Long64_t)branch->GetWriteBasket()+1, basketEntry, j);
+      TBasket *basket = branch->GetBasket(b);
+      Int_t *entryOffset = basket ? basket->GetEntryOffset() : 0;
+      if (!entryOffset) break;
+
+      char *buffer = basket->GetBufferRef()->Buffer();
+      Int_t nEntries = basket->GetNevBuf();
+      Long64_t end = std::min(last, basketEntry[b] + nEntries);
+      for (; j < end; ++j)
+	{
+	  Int_t e = j - basketEntry[b];
+	  Int_t start = entryOffset[e], stop = (e+1 < nEntries) ? entryOffset[e+1] : basket->GetLast();
+	  char *value = buffer + start + 6;
+	  Int_t n;
+	  frombuf(value, &n);
+	  if (n < 0 || stop - start != 10 + n*(Int_t)sizeof(Float_t)) break;
+
+	  if (offsets) offsets->push_back(column.size());
+	  size_t at = column.size();
+	  column.resize(at + n);
+	  for (Int_t k = 0; k < n; ++k) frombuf(value, &column[at + k]);
+	}
+      if (j < end) break;
+      branch->DropBaskets("all");              //Done with this one
+    }
+
+  for (; j < last; ++j)
+    {
+      branch->GetEntry(j);
+      if (offsets) offsets->push_back(column.size());
+      column.insert(column.end(), leaf->begin(), leaf->end());
+    }
+
+  if (offsets) offsets->push_back(column.size());
+}
+
+/*
+  Switches a branch back on, connects it to address and remembers its name
+*/
+template <class T> void TreeConnector::connect(const char *name, T *address, TBranch **branch)
+{
+  cTree->SetBranchStatus(name, 1);
+  cTree->SetBranchAddress(name, address, branch);
+  branchesRead.push_back(name);
+}
+
+/*
+  Gives the tree a TTreeCache that only holds the branches init() connected
+*/
+void TreeConnector::setupCache(Long64_t bytes)
+{
+  cTree->SetCacheSize(bytes);
+  for (int i = 0; i < (int)branchesRead.size(); ++i) cTree->AddBranchToCache(branchesRead[i], kTRUE);
+  cTree->StopCacheLearningPhase();
 }
 
 void TreeConnector::setAsData() { fileIsData = true; }
@@ -163,41 +353,44 @@ void TreeConnector::init(TTree *tree)
 
   cTree = tree;
 
+  cTree->SetBranchStatus("*", 0);          //Only the branches connected below get read
+  branchesRead.clear();
+
   if (fileIsData == false)
     {
-      cTree->SetBranchAddress("weight_mc", &weight_mc, &b_weight_mc);
-      cTree->SetBranchAddress("weight_pileup", &weight_pileup, &b_weight_pileup);
-      cTree->SetBranchAddress("weight_leptonSF", &weight_leptonSF, &b_weight_leptonSF);
-      //cTree->SetBranchAddress("weight_bTagSF_70", &weight_bTagSF_70, &b_weight_bTagSF_70);
-      //cTree->SetBranchAddress("weight_trackjet_bTagSF_70", &weight_trackjet_bTagSF_70, &b_weight_trackjet_bTagSF_70);
-      cTree->SetBranchAddress("weight_jvt", &weight_jvt, &b_weight_jvt);
+      connect("weight_mc", &weight_mc, &b_weight_mc);
+      connect("weight_pileup", &weight_pileup, &b_weight_pileup);
+      connect("weight_leptonSF", &weight_leptonSF, &b_weight_leptonSF);
+      //connect("weight_bTagSF_70", &weight_bTagSF_70, &b_weight_bTagSF_70);
+      //connect("weight_trackjet_bTagSF_70", &weight_trackjet_bTagSF_70, &b_weight_trackjet_bTagSF_70);
+      connect("weight_jvt", &weight_jvt, &b_weight_jvt);
     }
   
-  //  cTree->SetBranchAddress("el_pt", &el_pt, &b_el_pt);
-  //  cTree->SetBranchAddress("el_eta", &el_eta, &b_el_eta);
-  //  cTree->SetBranchAddress("el_phi", &el_phi, &b_el_phi);
-  //  cTree->SetBranchAddress("mu_pt", &mu_pt, &b_mu_pt);
-  //  cTree->SetBranchAddress("mu_eta", &mu_eta, &b_mu_eta);
-  //  cTree->SetBranchAddress("mu_phi", &mu_phi, &b_mu_phi);
-
-  cTree->SetBranchAddress("jet_pt", &jet_pt, &b_jet_pt);
-  cTree->SetBranchAddress("jet_eta", &jet_eta, &b_jet_eta);
-  cTree->SetBranchAddress("jet_phi", &jet_phi, &b_jet_phi);
-  // cTree->SetBranchAddress("jet_e", &jet_e, &b_jet_e);
-  // cTree->SetBranchAddress("jet_mv2c00", &jet_mv2c00, &b_jet_mv2c00);
-  // cTree->SetBranchAddress("jet_mv2c10", &jet_mv2c10, &b_jet_mv2c10);
-  // cTree->SetBranchAddress("jet_mv2c20", &jet_mv2c20, &b_jet_mv2c20);
-  // cTree->SetBranchAddress("jet_ip3dsv1", &jet_ip3dsv1, &b_jet_ip3dsv1);
-  // cTree->SetBranchAddress("jet_jvt", &jet_jvt, &b_jet_jvt);
-  // cTree->SetBranchAddress("jet_truthflav", &jet_truthflav, &b_jet_truthflav);
-  // cTree->SetBranchAddress("jet_isTrueHS", &jet_isTrueHS, &b_jet_isTrueHS);
-  // cTree->SetBranchAddress("jet_isbtagged_70", &jet_isbtagged_70, &b_jet_isbtagged_70);
-  cTree->SetBranchAddress("ljet_pt", &ljet_pt, &b_ljet_pt);
-  cTree->SetBranchAddress("ljet_eta", &ljet_eta, &b_ljet_eta);
-  cTree->SetBranchAddress("ljet_phi", &ljet_phi, &b_ljet_phi);
-  // cTree->SetBranchAddress("ljet_e", &ljet_e, &b_ljet_e);
-  cTree->SetBranchAddress("ljet_m", &ljet_m, &b_ljet_m);
-  // cTree->SetBranchAddress("ljet_sd12", &ljet_sd12, &b_ljet_sd12);
+  //  connect("el_pt", &el_pt, &b_el_pt);
+  //  connect("el_eta", &el_eta, &b_el_eta);
+  //  connect("el_phi", &el_phi, &b_el_phi);
+  //  connect("mu_pt", &mu_pt, &b_mu_pt);
+  //  connect("mu_eta", &mu_eta, &b_mu_eta);
+  //  connect("mu_phi", &mu_phi, &b_mu_phi);
+
+  connect("jet_pt", &jet_pt, &b_jet_pt);
+  connect("jet_eta", &jet_eta, &b_jet_eta);
+  connect("jet_phi", &jet_phi, &b_jet_phi);
+  // connect("jet_e", &jet_e, &b_jet_e);
+  // connect("jet_mv2c00", &jet_mv2c00, &b_jet_mv2c00);
+  // connect("jet_mv2c10", &jet_mv2c10, &b_jet_mv2c10);
+  // connect("jet_mv2c20", &jet_mv2c20, &b_jet_mv2c20);
+  // connect("jet_ip3dsv1", &jet_ip3dsv1, &b_jet_ip3dsv1);
+  // connect("jet_jvt", &jet_jvt, &b_jet_jvt);
+  // connect("jet_truthflav", &jet_truthflav, &b_jet_truthflav);
+  // connect("jet_isTrueHS", &jet_isTrueHS, &b_jet_isTrueHS);
+  // connect("jet_isbtagged_70", &jet_isbtagged_70, &b_jet_isbtagged_70);
+  connect("ljet_pt", &ljet_pt, &b_ljet_pt);
+  connect("ljet_eta", &ljet_eta, &b_ljet_eta);
+  connect("ljet_phi", &ljet_phi, &b_ljet_phi);
+  // connect("ljet_e", &ljet_e, &b_ljet_e);
+  connect("ljet_m", &ljet_m, &b_ljet_m);
+  // connect("ljet_sd12", &ljet_sd12, &b_ljet_sd12);
 }
 
 /*
@@ -0,0 +1,179 @@
+//////
+//This class is a light histogram with uniform bins, for the hot loop of
+//dmcHist. TH1F::Fill is a virtual call that looks the bin up through
+//TAxis and checks the Sumw2 state for every value; UniformHist::fill
+//takes whole arrays of values and weights instead. The bin numbers of a
+//block of values are worked out first in a plain loop with no branches,
+//which the compiler turns into SIMD instructions (build with -O3), and
+//the values are then added to their bins one after the other.
+//
+//It does exactly what TH1::Fill(x, w) does, with the same arithmetic in
+//the same order: the same bin for every value (including underflow,
+//overflow and NaN), the contents kept as Content (Float_t for a TH1F,
+//Double_t for a TH1D), Sumw2 switched on by the first weight that isn't 1,
+//and the same entries and statistics sums. copyTo() puts all of it into
+//an empty TH1F or TH1D with the same binning, so the result is bin for bin
+//and stat for stat the same as filling the ROOT histogram directly, and it
+//can be added, written and read by dmcMake and makePlots as usual.
+//////
+
+#ifndef UNIFORMHIST_H
+#define UNIFORMHIST_H
+
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+#include "TH1F.h"
+#include "TH1D.h"
+#include "TArrayD.h"
+using std::vector;
+
+
+template <typename Content>
+class UniformHist
+{
+ public:
+  UniformHist(int nbins, double xlow, double xup);
+
+  void fill(const Float_t *x, const Float_t *w, Long64_t n);
+  void reset();
+  template <class TH> void copyTo(TH *h) const;
+
+  int nbins;
+  double xlow, xup;
+
+ private:
+  static const int blockSize = 1024;      //Values whose bins are found at once
+
+  void findBins(const Float_t *x, int n, int *bins) const;
+  void startSumw2();
+
+  vector<Content> contents;               //Bin 0 is underflow, bin nbins+1 is overflow
+  vector<double> sumw2;
+  bool hasSumw2;
+  double entries;
+  double tsumw, tsumw2, tsumwx, tsumwx2;  //Sums over the bins in range, as in TH1
+};
+
+typedef UniformHist<Float_t> UniformHistF;
+typedef UniformHist<Double_t> UniformHistD;
+
+
+template <typename Content>
+UniformHist<Content>::UniformHist(int nbins_in, double xlow_in, double xup_in)
+  : nbins(nbins_in), xlow(xlow_in), xup(xup_in), contents(nbins_in+2, 0), sumw2(nbins_in+2, 0)
+{
+  reset();
+}
+
+
+/*
+  Empties the histogram
+*/
+template <typename Content>
+void UniformHist<Content>::reset()
+{
+  contents.assign(nbins+2, 0);
+  sumw2.assign(nbins+2, 0);
+  hasSumw2 = false;
+  entries = tsumw = tsumw2 = tsumwx = tsumwx2 = 0;
+}
+
+
+/*
+  Fills n values x[i] with weights w[i], in order
+*/
+template <typename Content>
+void UniformHist<Content>::fill(const Float_t *x, const Float_t *w, Long64_t n)
+{
+  int bins[blockSize];
+
+  for (Long64_t start = 0; start < n; start += blockSize)
+    {
+      int m = (n-start < blockSize) ? n-start : blockSize;
+      findBins(x+start, m, bins);
+
+      for (int i = 0; i < m; ++i)
+	{
+	  int bin = bins[i];
+	  double xi = x[start+i], wi = w[start+i];
+
+	  entries += 1;
+	  if (!hasSumw2 && wi != 1.0) startSumw2();
+	  if (hasSumw2) sumw2[bin] += wi*wi;
+	  contents[bin] += Content(wi);
+
+	  if (bin == 0 || bin > nbins) continue;            //Under and overflow aren't in the statistics
+	  tsumw   += wi;
+	  tsumw2  += wi*wi;
+	  tsumwx  += wi*xi;
+	  tsumwx2 += wi*xi*xi;
+	}
+    }
+}
+
+
+/*
+  Bin number of every value, the same as TAxis::FindBin for fixed bins. The
+  loop has no branches or early exits so that it is vectorised.
+*/
+template <typename Content>
+void UniformHist<Content>::findBins(const Float_t *x, int n, int *bins) const
+{
+  const double width = xup - xlow;
+
+  for (int i = 0; i < n; ++i)
+    {
+      double xi = x[i];
+      double t = nbins*(xi - xlow)/width;
+      t = (t > -1) ? t : -1;                   //Keeps the conversion to int defined (NaN ends up here too)
+      t = (t < nbins+1) ? t : nbins+1;
+      int inside = 1 + int(t);
+      bins[i] = (xi < xlow) ? 0 : (!(xi < xup) ? nbins+1 : inside);
+    }
+}
+
+
+/*
+  What TH1::Sumw2 does the first time a weight isn't 1: the errors of what
+  was filled so far are the contents
+*/
+template <typename Content>
+void UniformHist<Content>::startSumw2()
+{
+  for (int bin = 0; bin <= nbins+1; ++bin) sumw2[bin] = std::fabs(double(contents[bin]));
+  hasSumw2 = true;
+}
+
+
+/*
+  Puts the contents, errors, statistics and entries into h, which has to be
+  an empty TH1F or TH1D with the same bins
+*/
+template <typename Content>
+template <class TH>
+void UniformHist<Content>::copyTo(TH *h) const
+{
+  if (h->GetNbinsX() != nbins || h->GetXaxis()->GetXmin() != xlow || h->GetXaxis()->GetXmax() != xup)
+    throw std::invalid_argument(std::string("UniformHist::copyTo: ") + h->GetName() + " has different bins");
+  if (h->GetEntries() != 0)
+    throw std::invalid_argument(std::string("UniformHist::copyTo: ") + h->GetName() + " is not empty");
+
+  for (int bin = 0; bin <= nbins+1; ++bin) h->SetBinContent(bin, contents[bin]);
+
+  if (hasSumw2 || h->GetSumw2N() > 0)       //h may have Sumw2 on by default (TH1::SetDefaultSumw2)
+    {
+      if (h->GetSumw2N() == 0) h->Sumw2(kTRUE);
+      TArrayD *errors = h->GetSumw2();
+      for (int bin = 0; bin <= nbins+1; ++bin)
+	errors->SetAt(hasSumw2 ? sumw2[bin] : std::fabs(double(contents[bin])), bin);
+    }
+
+  double stats[4] = { tsumw, tsumw2, tsumwx, tsumwx2 };
+  h->PutStats(stats);
+  h->SetEntries(entries);
+}
+
+
+
+#endif /*UNIFORMHIST_H*/
@@ -0,0 +1,276 @@
+//////
+//This class keeps, for every input file, the number of entries of its
+//nominal tree and the sum of the weights and of the squared weights
+//(weight_mc * weight_pileup * weight_leptonSF * weight_jvt, multiplied in
+//the same order as the event loop, and 1 for data). The samples can then
+//be normalised from these sums without reading any events again.
+//
+//The sums are kept in a small text file, one input file per line:
+//
+//  path  size  mtime  isData  entries  sumw  sumw2
+//
+//separated by tabs. update() only scans the files that aren't in the index
+//yet or whose size or modification time changed since they were scanned,
+//with several threads at once, and only the four weight branches are read.
+//Files that are empty or have no entries are kept with entries 0, so they
+//aren't opened again either; files that can't be opened or have no tree
+//aren't kept, so they are scanned again the next time. The file is
+//written under a temporary name and renamed, so a run that dies never
+//leaves a broken index.
+//////
+
+#ifndef WEIGHTINDEX_H
+#define WEIGHTINDEX_H
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include "TSystem.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TString.h"
+#include "TreeConnector.h"
+using std::vector;
+
+
+struct WeightSum
+{
+  Long64_t entries;
+  double sumw, sumw2;
+};
+
+
+class WeightIndex
+{
+ public:
+  WeightIndex(const std::string &path);
+
+  bool update(const vector<TString> &files, const vector<bool> &isData, int nThreads);
+  bool get(const TString &file, WeightSum &sum) const;
+  bool sum(const vector<TString> &files, WeightSum &total) const;
+  void report();
+
+ private:
+  struct Record
+  {
+    Long64_t size;
+    Long_t mtime;
+    bool isData;
+    WeightSum sum;
+  };
+
+  static bool scan(const TString &file, bool isData, WeightSum &sum);
+  bool load();
+  bool save();
+
+  std::string path;
+  std::map<std::string, Record> records;
+  int reused, scanned, missing, failed;
+};
+
+
+WeightIndex::WeightIndex(const std::string &path_in)
+  : path(path_in), reused(0), scanned(0), missing(0), failed(0)
+{
+  load();
+}
+
+
+/*
+  Reads the index file, if there is one
+*/
+bool WeightIndex::load()
+{
+  std::ifstream str(path.c_str());
+  if (str.fail()) return false;
+
+  std::string line;
+  while (getline(str, line))
+    {
+      if (line.empty() || line[0] == '#') continue;
+
+      size_t tab = line.find('\t');
+      if (tab == std::string::npos) continue;
+      Record r;
+      std::stringstream fields(line.substr(tab+1));
+      if (fields >> r.size >> r.mtime >> r.isData >> r.sum.entries >> r.sum.sumw >> r.sum.sumw2)
+	records[line.substr(0, tab)] = r;
+    }
+  return true;
+}
+
+
+/*
+  Writes the index file (under a temporary name first)
+*/
+bool WeightIndex::save()
+{
+  std::stringstream tmp;
+  tmp << path << ".part" << getpid();
+
+  std::ofstream str(tmp.str().c_str());
+  if (str.fail()) return false;
+
+  str << "# path\tsize\tmtime\tisData\tentries\tsumw\tsumw2" << std::endl << std::setprecision(17);
+  for (std::map<std::string, Record>::const_iterator it = records.begin(); it != records.end(); ++it)
+    {
+      const Record &r = it->second;
+      str << it->first << "\t" << r.size << "\t" << r.mtime << "\t" << r.isData << "\t"
+	  << r.sum.entries << "\t" << r.sum.sumw << "\t" << r.sum.sumw2 << std::endl;
+    }
+  str.close();
+  if (str.fail()) { gSystem->Unlink(tmp.str().c_str()); return false; }
+
+  if (gSystem->Rename(tmp.str().c_str(), path.c_str()) != 0) { gSystem->Unlink(tmp.str().c_str()); return false; }
+  return true;
+}
+
+
+/*
+  Scans the files that are new or have changed since the index was made,
+  with nThreads threads, and saves the index if anything changed. Files
+  that can't be found are left out. Returns false if the index couldn't be
+  saved.
+*/
+bool WeightIndex::update(const vector<TString> &files, const vector<bool> &isData, int nThreads)
+{
+  vector<int> todo;
+  vector<Record> found(files.size());
+  for (int i = 0; i < (int)files.size(); ++i)
+    {
+      FileStat_t stat;
+      if (gSystem->GetPathInfo(files[i], stat) != 0) { ++missing; continue; }
+      found[i].size = stat.fSize;
+      found[i].mtime = stat.fMtime;
+      found[i].isData = isData[i];
+
+      std::map<std::string, Record>::const_iterator it = records.find(files[i].Data());
+      if (it != records.end() && it->second.size == stat.fSize && it->second.mtime == stat.fMtime
+	  && it->second.isData == isData[i]) ++reused;
+      else todo.push_back(i);
+    }
+  if (todo.empty()) return true;
+
+  std::atomic<int> next(0);
+  std::mutex lock;
+  auto worker = [&]()
+    {
+      int t;
+      while ((t = next++) < (int)todo.size())
+	{
+	  int i = todo[t];
+	  bool ok = scan(files[i], isData[i], found[i].sum);
+	  std::lock_guard<std::mutex> guard(lock);
+	  if (!ok) { ++failed; continue; }
+	  records[files[i].Data()] = found[i];
+	  ++scanned;
+	}
+    };
+
+  if (nThreads <= 1) worker();
+  else
+    {
+      vector<std::thread> pool;
+      for (int t = 0; t < nThreads; ++t) pool.push_back(std::thread(worker));
+      for (int t = 0; t < nThreads; ++t) pool[t].join();
+    }
+
+  if (!save()) { std::cout << path << " could not be written!" << std::endl; return false; }
+  return true;
+}
+
+
+/*
+  Reads the weights of one input file. Returns false if the file couldn't
+  be opened or the nominal tree wasn't found; empty files give entries 0.
+*/
+bool WeightIndex::scan(const TString &file, bool isData, WeightSum &sum)
+{
+  sum.entries = 0; sum.sumw = 0; sum.sumw2 = 0;
+
+  TFile *f = TFile::Open(file, "READ");
+  if (!f || f->IsZombie()) { delete f; return false; }
+  if (f->GetSize() < 1) { delete f; return true; }
+
+  TTree *tree = 0;
+  TreeConnector tc;
+  tc.getTree(f, tree, "nominal");
+  if (!tree) { delete f; return false; }
+
+  sum.entries = tree->GetEntries();
+  if (isData) { sum.sumw = sum.sumw2 = sum.entries; delete f; return true; }
+
+  tc.setAsMC();
+  tc.init(tree);
+  tree->SetCacheSize(10000000);
+  const char *names[4] = { "weight_mc", "weight_pileup", "weight_leptonSF", "weight_jvt" };
+  TBranch *weights[4] = { tc.b_weight_mc, tc.b_weight_pileup, tc.b_weight_leptonSF, tc.b_weight_jvt };
+  for (int b = 0; b < 4; ++b) tree->AddBranchToCache(names[b], kTRUE);
+
+  for (Long64_t j = 0; j < sum.entries; ++j)
+    {
+      for (int b = 0; b < 4; ++b) weights[b]->GetEntry(j);
+      Float_t totalWeight = tc.weight_mc*tc.weight_pileup*tc.weight_leptonSF*tc.weight_jvt;
+      sum.sumw  += totalWeight;
+      sum.sumw2 += (double)totalWeight*totalWeight;
+    }
+
+  delete f;
+  return true;
+}
+
+
+/*
+  The sums of one input file. Returns false if it isn't in the index.
+*/
+bool WeightIndex::get(const TString &file, WeightSum &sum) const
+{
+  std::map<std::string, Record>::const_iterator it = records.find(file.Data());
+  if (it == records.end()) return false;
+  sum = it->second.sum;
+  return true;
+}
+
+
+/*
+  The sums of several input files added up into total. Returns false if
+  any of the files isn't in the index (total then only has the others).
+*/
+bool WeightIndex::sum(const vector<TString> &files, WeightSum &total) const
+{
+  WeightSum empty = { 0, 0, 0 };
+  total = empty;
+  bool complete = true;
+  for (int i = 0; i < (int)files.size(); ++i)
+    {
+      WeightSum s;
+      if (!get(files[i], s)) { complete = false; continue; }
+      total.entries += s.entries; total.sumw += s.sumw; total.sumw2 += s.sumw2;
+    }
+  return complete;
+}
+
+
+/*
+  Prints how many files were taken from the index and how many scanned
+*/
+void WeightIndex::report()
+{
+  std::cout << "Weight index (" << path << "): "
+	    << reused << " files reused, " << scanned << " scanned";
+  if (missing > 0) std::cout << ", " << missing << " not found";
+  if (failed > 0) std::cout << ", " << failed << " could not be read";
+  std::cout << std::endl;
+}
+
+
+
+#endif /*WEIGHTINDEX_H*/
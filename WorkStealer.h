@@ -0,0 +1,247 @@
+//////
+//This class hands out pieces of the event loop to the dmcHist worker
+//threads. A piece (EntryRange) is either a whole input file that has not
+//been looked at yet, or a range of entries of the nominal tree that starts
+//and ends on a ROOT cluster boundary. Every worker has its own queue and
+//takes from the front of it. When a worker's queue runs dry it steals from
+//the back of the fullest queue, so one huge file gets shared out instead
+//of keeping a single thread busy while the others sit idle.
+//
+//Each worker also keeps track of how long it was busy and how long it was
+//waiting for work, which is printed by report() at the end of the run.
+//////
+
+#ifndef WORKSTEALER_H
+#define WORKSTEALER_H
+
+#include <iostream>
+#include <iomanip>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "TTree.h"
+using std::vector;
+
+
+struct EntryRange
+{
+  int fileNum;          //Index of the file in the text file
+  int part;             //Index of the range inside the file
+  Long64_t first;       //First entry of the range
+  Long64_t last;        //One past the last entry, or -1 for a whole file that hasn't been split yet
+};
+
+
+class WorkStealer
+{
+ public:
+  WorkStealer(int nWorkers);
+
+  void push(int worker, const EntryRange &range);
+  void pushFront(int worker, const EntryRange &range);
+  bool next(int worker, EntryRange &range);
+  void finished(int worker);
+  void stop();
+  void report();
+
+  static vector<EntryRange> split(TTree *tree, int fileNum, Long64_t rangeEntries);
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Worker
+  {
+    std::deque<EntryRange> queue;
+    std::mutex lock;
+    double busy, idle;            //Seconds spent working and waiting
+    int ranges, stolen;
+    Clock::time_point since;      //When the current busy or idle stretch started
+  };
+
+  bool steal(int thief, EntryRange &range);
+
+  vector<Worker> workers;
+  std::atomic<int> pending;       //Ranges pushed but not finished yet
+  std::atomic<bool> stopped;
+};
+
+
+WorkStealer::WorkStealer(int nWorkers)
+  : workers(nWorkers), pending(0), stopped(false)
+{
+  for (int w = 0; w < nWorkers; ++w)
+    {
+      workers[w].busy = workers[w].idle = 0;
+      workers[w].ranges = workers[w].stolen = 0;
+      workers[w].since = Clock::now();
+    }
+}
+
+
+/*
+  Adds a range to the back of a worker's queue
+*/
+void WorkStealer::push(int worker, const EntryRange &range)
+{
+  ++pending;
+  std::lock_guard<std::mutex> guard(workers[worker].lock);
+  workers[worker].queue.push_back(range);
+}
+
+
+/*
+  Adds a range to the front of a worker's queue, so the worker takes it next
+*/
+void WorkStealer::pushFront(int worker, const EntryRange &range)
+{
+  ++pending;
+  std::lock_guard<std::mutex> guard(workers[worker].lock);
+  workers[worker].queue.push_front(range);
+}
+
+
+/*
+  Gets the next range for a worker, stealing one if its own queue is empty.
+  Waits while other workers may still push new ranges, and returns false
+  once everything has been processed (or stop() was called).
+*/
+bool WorkStealer::next(int worker, EntryRange &range)
+{
+  Worker &me = workers[worker];
+  me.since = Clock::now();
+
+  while (!stopped)
+    {
+      bool found = false;
+      {
+	std::lock_guard<std::mutex> guard(me.lock);
+	if (!me.queue.empty()) { range = me.queue.front(); me.queue.pop_front(); found = true; }
+      }
+      if (!found) found = steal(worker, range);
+
+      if (found)
+	{
+	  Clock::time_point now = Clock::now();
+	  me.idle += std::chrono::duration<double>(now - me.since).count();
+	  me.since = now;
+	  ++me.ranges;
+	  return true;
+	}
+
+      if (pending == 0) break;                           //Nothing queued and nobody can add more
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+  me.idle += std::chrono::duration<double>(Clock::now() - me.since).count();
+  return false;
+}
+
+
+/*
+  Marks the range a worker took with next() as done
+*/
+void WorkStealer::finished(int worker)
+{
+  Worker &me = workers[worker];
+  Clock::time_point now = Clock::now();
+  me.busy += std::chrono::duration<double>(now - me.since).count();
+  me.since = now;
+  --pending;
+}
+
+
+/*
+  Makes every call to next() return false, used when the run has to abort
+*/
+void WorkStealer::stop() { stopped = true; }
+
+
+/*
+  Takes a range from the back of the fullest queue
+*/
+bool WorkStealer::steal(int thief, EntryRange &range)
+{
+  int victim = -1;
+  size_t most = 0;
+
+  for (int w = 0; w < (int)workers.size(); ++w)
+    {
+      if (w == thief) continue;
+      std::lock_guard<std::mutex> guard(workers[w].lock);
+      if (workers[w].queue.size() > most) { most = workers[w].queue.size(); victim = w; }
+    }
+  if (victim < 0) return false;
+
+  std::lock_guard<std::mutex> guard(workers[victim].lock);
+  if (workers[victim].queue.empty()) return false;      //Somebody else got there first
+
+  range = workers[victim].queue.back();
+  workers[victim].queue.pop_back();
+  ++workers[thief].stolen;
+  return true;
+}
+
+
+/*
+  Prints how the time of every worker was split between work and waiting
+*/
+void WorkStealer::report()
+{
+  std::cout << "Worker load:" << std::endl;
+
+  for (int w = 0; w < (int)workers.size(); ++w)
+    {
+      double total = workers[w].busy + workers[w].idle;
+      std::cout << "  worker " << std::setw(3) << w
+		<< "  busy " << std::fixed << std::setprecision(2) << std::setw(8) << workers[w].busy << " s"
+		<< "  idle " << std::setw(8) << workers[w].idle << " s"
+		<< "  (" << std::setprecision(1) << std::setw(5) << (total > 0 ? 100*workers[w].busy/total : 0.0) << "% busy)"
+		<< "  ranges " << workers[w].ranges << " (" << workers[w].stolen << " stolen)"
+		<< std::endl;
+    }
+  std::cout.unsetf(std::ios::fixed);
+  std::cout << std::setprecision(6);
+}
+
+
+/*
+  Splits a tree into ranges of whole clusters with at least rangeEntries
+  entries each (the last one may be smaller). The split only depends on
+  the tree and rangeEntries, never on the number of threads.
+*/
+vector<EntryRange> WorkStealer::split(TTree *tree, int fileNum, Long64_t rangeEntries)
+{
+  vector<EntryRange> ranges;
+  Long64_t nentries = tree->GetEntries();
+
+  TTree::TClusterIterator clusters = tree->GetClusterIterator(0);
+  Long64_t start = 0, end = 0;
+
+  while (clusters.Next() < nentries)                     //Next() moves to the next cluster and returns its first entry
+    {
+      end = clusters.GetNextEntry();                     //One past the last entry of this cluster
+      if (end > nentries) end = nentries;
+
+      if (end - start >= rangeEntries || end == nentries)
+	{
+	  EntryRange r = { fileNum, (int)ranges.size(), start, end };
+	  ranges.push_back(r);
+	  start = end;
+	}
+    }
+
+  if (start < nentries)                                  //Shouldn't happen, but never drop entries
+    {
+      EntryRange r = { fileNum, (int)ranges.size(), start, nentries };
+      ranges.push_back(r);
+    }
+
+  return ranges;
+}
+
+
+
+#endif /*WORKSTEALER_H*/
@@ -0,0 +1,379 @@
+///////////////////////////////////////////////////////////////////////////
+// This program times the pieces of the dmcHist event loop on a single
+//  input file, so different ways of doing the same work can be compared.
+//  Every test fills the normal dmcHist histograms and checks that the
+//  result is bin for bin the same as the plain GetEntry loop.
+//
+//  Tests:
+//    read  - GetEntry for every event vs. TreeConnector::readBatch
+//    fill  - TH1F::Fill for every value vs. UniformHist::fill on arrays
+//            (no input file, the values are random)
+//    concurrent - the ConcurrentHist fill modes with 1, 2, 4, ... threads:
+//            fills/s, memory, and a check that every mode and thread
+//            count gives the same histogram, and that shards fill the
+//            same bins when they are run twice
+//    match - JetMatcher on events with more and more jets vs. a plain
+//            loop over the pairs: time per event and a check that both
+//            match the same jets (no input file, the jets are random)
+//
+//  Execute the program with no arguments to show a usage statement.
+///////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "TROOT.h"
+#include "TFile.h"
+#include "TreeConnector.h"
+#include "HistSet.h"
+#include "UniformHist.h"
+#include "ConcurrentHist.h"
+#include "JetMatcher.h"
+
+using namespace std;
+
+void usage();
+bool sameHists(HistSet &a, HistSet &b);
+double benchRead(TString path, Long64_t maxEntries, HistSet &hists, bool bulk);
+bool sameHist(TH1 *a, TH1 *b);
+void benchFill(Long64_t nValues);
+void benchConcurrent(Long64_t nValues);
+double fillConcurrent(ConcurrentHist &hist, const vector<Float_t> &x, const vector<Float_t> &w, int nThreads, bool swapSlices);
+void benchMatch(Long64_t nEvents);
+void randomValues(Long64_t nValues, vector<Float_t> &x, vector<Float_t> &w);
+
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3) { usage(); return 1; }
+
+  if (string(argv[1]) == "fill") { benchFill(atoll(argv[2])); return 0; }
+  if (string(argv[1]) == "concurrent") { benchConcurrent(atoll(argv[2])); return 0; }
+  if (string(argv[1]) == "match") { benchMatch(atoll(argv[2])); return 0; }
+
+  gROOT->ProcessLine("#include <vector>"); //Problems occur with the branches of vector<float> without this line
+
+  string test(argv[1]);
+  TString path(argv[2]);
+  Long64_t maxEntries = (argc > 3) ? atoll(argv[3]) : -1;
+  int nbins = 100;
+
+  if (test == "read")
+    {
+      HistSet warmup(nbins), perEvent(nbins), batched(nbins);
+
+      //Read the file once first so both versions start with it in the page cache
+      if (benchRead(path, maxEntries, warmup, false) < 0) return 1;
+
+      double tEvent = benchRead(path, maxEntries, perEvent, false);
+      double tBulk  = benchRead(path, maxEntries, batched, true);
+
+      cout << fixed << setprecision(3)
+	   << "GetEntry loop:  " << tEvent << " s" << endl
+	   << "readBatch loop: " << tBulk  << " s" << endl
+	   << "Speed up:       " << tEvent / tBulk << "x" << endl;
+      cout << "Histograms " << (sameHists(perEvent, batched) ? "match" : "DO NOT MATCH") << endl;
+    }
+  else { usage(); return 1; }
+
+  return 0;
+}//End main
+
+
+/*
+  Fills hists from the nominal tree of one file and returns the seconds it
+  took (-1 if the file couldn't be read)
+*/
+double benchRead(TString path, Long64_t maxEntries, HistSet &hists, bool bulk)
+{
+  TFile *f = TFile::Open(path, "READ");
+  if (!f || f->IsZombie()) { cout << path << " could not be opened!" << endl; return -1; }
+
+  TTree *tree = 0;
+  TreeConnector tc;
+  tc.getTree(f, tree, "nominal");
+  if (!tree) { cout << path << " has no nominal tree!" << endl; delete f; return -1; }
+
+  if (path.Contains("data", TString::kExact)) tc.setAsData();
+  else tc.setAsMC();
+  tc.init(tree);
+
+  Long64_t nentries = tree->GetEntries();
+  if (maxEntries > 0 && maxEntries < nentries) nentries = maxEntries;
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  if (bulk)
+    {
+      EventBatch batch;
+      const Long64_t batchSize = 10000;
+      for (Long64_t j = 0; j < nentries; j += batchSize)
+	{
+	  tc.readBatch(j, (nentries-j < batchSize ? nentries : j+batchSize), batch);
+	  hists.fillBatch(batch);
+	}
+      hists.flush();
+    }
+  else
+    {
+      Float_t totalWeight = 1.0;
+      for (Long64_t j = 0; j < nentries; ++j)
+	{
+	  tree->GetEntry(j);
+	  if(!tc.isData()) { totalWeight = tc.weight_mc*tc.weight_pileup*tc.weight_leptonSF*tc.weight_jvt; }
+	  hists.fill(tc, totalWeight);
+	}
+    }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cout << (bulk ? "  readBatch: " : "  GetEntry:  ") << nentries << " events, "
+       << nentries / seconds << " events/s" << endl;
+
+  delete f;
+  return seconds;
+}//End method: benchRead
+
+
+/*
+  Fills nValues random values into a TH1F one at a time with Fill, and into
+  a UniformHistF in arrays, and compares the time and the histograms
+*/
+void benchFill(Long64_t nValues)
+{
+  if (nValues < 1) { usage(); return; }
+
+  vector<Float_t> x, w;
+  randomValues(nValues, x, w);
+
+  TH1::AddDirectory(kFALSE);
+  TH1F perValue("perValue", "TH1F::Fill", 100, 0, 2000000);
+  TH1F arrays("arrays", "UniformHist::fill", 100, 0, 2000000);
+  UniformHistF fast(100, 0, 2000000);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (Long64_t i = 0; i < nValues; ++i) perValue.Fill(x[i], w[i]);
+  double tFill = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  start = chrono::steady_clock::now();
+  fast.fill(&x[0], &w[0], nValues);
+  fast.copyTo(&arrays);
+  double tFast = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cout << fixed << setprecision(3)
+       << "TH1F::Fill:        " << tFill << " s  (" << nValues / tFill / 1e6 << " M fills/s)" << endl
+       << "UniformHist::fill: " << tFast << " s  (" << nValues / tFast / 1e6 << " M fills/s)" << endl
+       << "Speed up:          " << tFill / tFast << "x" << endl;
+  cout << "Histograms " << (sameHist(&perValue, &arrays) ? "match" : "DO NOT MATCH") << endl;
+}//End method: benchFill
+
+
+/*
+  Fills nValues random values into one shared histogram with every
+  ConcurrentHist mode and 1, 2, 4, ... threads (each thread gets an equal
+  slice of the values), and prints the fills/s and memory of each. Shards
+  are filled a second time with the slices handed out the other way round,
+  as work stealing would, and have to give the same bins.
+*/
+void benchConcurrent(Long64_t nValues)
+{
+  if (nValues < 1) { usage(); return; }
+
+  vector<Float_t> x, w;
+  randomValues(nValues, x, w);
+
+  int maxThreads = thread::hardware_concurrency();
+  if (maxThreads < 1) maxThreads = 1;
+
+  TH1::AddDirectory(kFALSE);
+  TH1D reference("reference", "", 100, 0, 2000000);
+  bool haveReference = false, allMatch = true;
+
+  cout << "    mode  threads    time (s)   M fills/s   memory (MB)" << endl;
+  ConcurrentHist::Mode modes[3] = { ConcurrentHist::kShards, ConcurrentHist::kAtomic, ConcurrentHist::kBuffered };
+  for (int m = 0; m < 3; ++m)
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2)
+      {
+	ConcurrentHist hist(modes[m], nThreads, 100, 0, 2000000);
+	double seconds = fillConcurrent(hist, x, w, nThreads, false);
+
+	TH1D result("result", "", 100, 0, 2000000);
+	hist.copyTo(&result);
+	if (!haveReference) { hist.copyTo(&reference); haveReference = true; }
+	allMatch = allMatch && sameHist(&reference, &result);
+
+	if (modes[m] == ConcurrentHist::kShards)
+	  {
+	    ConcurrentHist again(modes[m], nThreads, 100, 0, 2000000);
+	    fillConcurrent(again, x, w, nThreads, true);
+	    TH1D second("second", "", 100, 0, 2000000);
+	    again.copyTo(&second);
+	    allMatch = allMatch && sameHist(&result, &second);
+	  }
+
+	cout << setw(8) << ConcurrentHist::modeName(modes[m]) << setw(9) << nThreads << fixed << setprecision(3)
+	     << setw(12) << seconds << setw(12) << nValues / seconds / 1e6
+	     << setw(14) << hist.bytes()/1e6 << endl;
+      }
+
+  cout << "Histograms " << (allMatch ? "match" : "DO NOT MATCH") << " for every mode, number of threads and run" << endl;
+}//End method: benchConcurrent
+
+
+/*
+  Fills x and w into hist with nThreads threads, each one an equal slice
+  of them (thread t gets the slice nThreads-1-t with swapSlices), and
+  returns the seconds it took
+*/
+double fillConcurrent(ConcurrentHist &hist, const vector<Float_t> &x, const vector<Float_t> &w, int nThreads, bool swapSlices)
+{
+  Long64_t nValues = x.size();
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<thread> pool;
+  for (int t = 0; t < nThreads; ++t)
+    pool.push_back(thread([&, t]()
+      {
+	int slice = swapSlices ? nThreads-1-t : t;
+	Long64_t first = nValues*slice/nThreads, last = nValues*(slice+1)/nThreads;
+	hist.fill(t, &x[first], &w[first], last-first);
+	hist.flush(t);
+      }));
+  for (int t = 0; t < nThreads; ++t) pool[t].join();
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}//End method: fillConcurrent
+
+
+/*
+  Matches the jets of nEvents random events with JetMatcher and with a
+  loop over the pairs that branches on every one, for several numbers of
+  small and large jets per event, and prints the time per event of each
+*/
+void benchMatch(Long64_t nEvents)
+{
+  if (nEvents < 1) { usage(); return; }
+
+  const Float_t pi = 3.14159265358979f;
+  const int nSizes = 5;
+  int nJets[nSizes]  = { 5, 10, 20, 40, 80 };
+  int nLjets[nSizes] = { 2, 3, 4, 6, 8 };
+
+  mt19937 gen(12345);
+  uniform_real_distribution<float> eta(-2.5, 2.5), phi(-pi, pi);
+  JetMatcher matcher;
+  bool allMatch = true;
+
+  cout << "  small  large   JetMatcher (ns/event)   pair loop (ns/event)" << endl;
+  for (int s = 0; s < nSizes; ++s)
+    {
+      int nj = nJets[s], nl = nLjets[s];
+      vector<Float_t> jetEta(nEvents*nj), jetPhi(nEvents*nj), ljetEta(nEvents*nl), ljetPhi(nEvents*nl);
+      for (Long64_t i = 0; i < nEvents*nj; ++i) { jetEta[i] = eta(gen); jetPhi[i] = phi(gen); }
+      for (Long64_t i = 0; i < nEvents*nl; ++i) { ljetEta[i] = eta(gen); ljetPhi[i] = phi(gen); }
+
+      vector<int> fast(nEvents*nj), plain(nEvents*nj);
+
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      for (Long64_t e = 0; e < nEvents; ++e)
+	{
+	  matcher.match(&jetEta[e*nj], &jetPhi[e*nj], nj, &ljetEta[e*nl], &ljetPhi[e*nl], nl);
+	  for (int j = 0; j < nj; ++j) fast[e*nj+j] = matcher.matched(j);
+	}
+      double tFast = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+      start = chrono::steady_clock::now();
+      for (Long64_t e = 0; e < nEvents; ++e)
+	for (int j = 0; j < nj; ++j)
+	  {
+	    Float_t best = matcher.radius*matcher.radius;
+	    int index = -1;
+	    for (int l = 0; l < nl; ++l)
+	      {
+		Float_t deta = jetEta[e*nj+j] - ljetEta[e*nl+l];
+		Float_t dphi = fabs(jetPhi[e*nj+j] - ljetPhi[e*nl+l]);
+		if (2*pi - dphi < dphi) dphi = 2*pi - dphi;
+		Float_t dR2 = deta*deta + dphi*dphi;
+		if (dR2 < best) { best = dR2; index = l; }
+	      }
+	    plain[e*nj+j] = index;
+	  }
+      double tPlain = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+      allMatch = allMatch && fast == plain;
+      cout << setw(7) << nj << setw(7) << nl << fixed << setprecision(1)
+	   << setw(24) << tFast / nEvents * 1e9 << setw(23) << tPlain / nEvents * 1e9 << endl;
+    }
+
+  cout << "Matches " << (allMatch ? "agree" : "DO NOT AGREE") << endl
+       << "(compare with the time per event of \"dmcBench read\")" << endl;
+}//End method: benchMatch
+
+
+/*
+  Jet Pt like values, with some in the under and overflow, and MC like weights
+*/
+void randomValues(Long64_t nValues, vector<Float_t> &x, vector<Float_t> &w)
+{
+  mt19937 gen(12345);
+  exponential_distribution<float> pt(1/150000.);
+  normal_distribution<float> weight(1.0, 0.3);
+  x.resize(nValues);
+  w.resize(nValues);
+  for (Long64_t i = 0; i < nValues; ++i) { x[i] = pt(gen) - 10000; w[i] = weight(gen); }
+}//End method: randomValues
+
+
+/*
+  True if every bin (including under and overflow), the entries, and the
+  statistics of two histograms match
+*/
+bool sameHist(TH1 *a, TH1 *b)
+{
+  for (int bin = 0; bin <= a->GetNbinsX()+1; ++bin)
+    {
+      if (a->GetBinContent(bin) != b->GetBinContent(bin)) return false;
+      if (a->GetBinError(bin) != b->GetBinError(bin)) return false;
+    }
+  if (a->GetEntries() != b->GetEntries()) return false;
+
+  double sa[4], sb[4];
+  a->GetStats(sa);
+  b->GetStats(sb);
+  for (int i = 0; i < 4; ++i) if (sa[i] != sb[i]) return false;
+
+  return true;
+}//End method: sameHist
+
+
+/*
+  True if every histogram of two sets matches
+*/
+bool sameHists(HistSet &a, HistSet &b)
+{
+  vector<TH1F*> ha = a.all(), hb = b.all();
+
+  for (int h = 0; h < (int)ha.size(); ++h)
+    if (!sameHist(ha[h], hb[h])) return false;
+
+  return true;
+}//End method: sameHists
+
+
+void usage()
+{
+  cout << "Usage: dmcBench [test] [rootFile] [maxEntries]" << endl
+       << "       dmcBench fill|concurrent [nValues]" << endl
+       << "       dmcBench match [nEvents]" << endl << endl
+       << "Times one part of the dmcHist event loop on the nominal tree "
+       << "of rootFile (all entries unless maxEntries is given)." << endl << endl
+       << "Tests:" << endl
+       << "  read   GetEntry for every event vs. TreeConnector::readBatch" << endl
+       << "  fill   TH1F::Fill vs. UniformHist::fill on nValues random values" << endl
+       << "  concurrent  ConcurrentHist modes with 1, 2, 4, ... threads on nValues" << endl
+       << "         random values (fills/s and memory)" << endl
+       << "  match  JetMatcher vs. a loop over the pairs on nEvents random events" << endl
+       << "         with 5 to 80 small jets (time per event)" << endl;
+}//End method: usage
@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////
+// This program writes synthetic input files for dmcHist (see
+//  NtupleGenerator.h) and a text file listing them, like ttbar.txt, so
+//  dmcHist and dmcBench can be run without access to the real ntuples:
+//
+//    dmcGen --files 8 --events 100000 /tmp/dmc/gen
+//    dmcHist --input-dir /tmp/dmc/ gen.txt
+//
+//  The files are PREFIX_0.root, PREFIX_1.root, ... and the list is
+//  PREFIX.txt. dmcHist decides that a file is data from "data" in its
+//  path, so give "--data" a PREFIX with "data" in it.
+//
+//  Execute the program with no arguments to show a usage statement.
+///////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include "TROOT.h"
+#include "TSystem.h"
+#include "NtupleGenerator.h"
+
+using namespace std;
+
+void usage();
+
+
+int main(int argc, char* argv[])
+{
+  NtupleGenerator gen;
+  int nFiles = 1;
+  Long64_t nEvents = 100000;           //Per file
+  unsigned seed = 1;
+  string prefix;
+
+  for (int a = 1; a < argc; ++a)
+    {
+      string arg(argv[a]);
+
+      if (arg == "--files" && a+1 < argc) { nFiles = atoi(argv[++a]); }
+      else if (arg == "--events" && a+1 < argc) { nEvents = atoll(argv[++a]); }
+      else if (arg == "--seed" && a+1 < argc) { seed = atoi(argv[++a]); }
+      else if (arg == "--data") { gen.isData = true; }
+      else if (arg == "--jets" && a+1 < argc) { gen.nJets = atof(argv[++a]); }
+      else if (arg == "--ljets" && a+1 < argc) { gen.nLjets = atof(argv[++a]); }
+      else if (arg == "--extra" && a+1 < argc) { gen.nExtra = atoi(argv[++a]); }
+      else if (arg == "--compression" && a+1 < argc) { gen.compression = atoi(argv[++a]); }
+      else if (arg == "--auto-flush" && a+1 < argc) { gen.autoFlush = atoll(argv[++a]); }
+      else if (prefix.empty() && arg.substr(0, 2) != "--") { prefix = arg; }
+      else { usage(); return 1; }
+    }
+  if (prefix.empty() || nFiles < 1 || nEvents < 1 || gen.nJets < 0 || gen.nLjets < 0 || gen.nExtra < 0) { usage(); return 1; }
+  if (gen.isData && prefix.find("data") == string::npos)
+    cout << "Warning: dmcHist will treat these files as MC, there is no \"data\" in " << prefix << endl;
+
+  gROOT->ProcessLine("#include <vector>"); //Problems occur with the branches of vector<float> without this line
+
+  string listName = prefix + ".txt";
+  ofstream list(listName.c_str());
+  if (list.fail()) { cout << listName << " could not be written!" << endl; return 1; }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  Long64_t totalBytes = 0;
+  for (int i = 0; i < nFiles; ++i)
+    {
+      TString path = TString::Format("%s_%d.root", prefix.c_str(), i);
+      cout << "Writing " << path << " (" << nEvents << " events)..." << endl;
+      if (!gen.write(path, nEvents, seed + i)) { cout << path << " could not be written!" << endl; return 1; }
+
+      FileStat_t stat;
+      if (gSystem->GetPathInfo(path, stat) == 0) totalBytes += stat.fSize;
+      list << path << endl;
+    }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << "Finished: " << nFiles << " files, " << fixed << setprecision(1) << totalBytes/1e6 << " MB in "
+       << seconds << " s, listed in " << listName << endl;
+  return 0;
+}//End main
+
+
+
+void usage()
+{
+  cout << "Usage: dmcGen [options] PREFIX" << endl
+       << "Writes synthetic input files PREFIX_0.root, PREFIX_1.root, ... and the list PREFIX.txt" << endl
+       << "--files N           Number of files (1)." << endl
+       << "--events N          Events in every file (100000)." << endl
+       << "--seed S            Seed of the first file, the others use S+1, S+2, ... (1)." << endl
+       << "--data              Data files, without the weight branches." << endl
+       << "--jets X            Mean number of small jets per event (6)." << endl
+       << "--ljets X           Mean number of large jets per event (1.6)." << endl
+       << "--extra N           Unread branches, like the rest of the ntuple (20)." << endl
+       << "--compression C     ROOT compression settings, e.g. 101 zlib, 207 lzma, 505 zstd (101)." << endl
+       << "--auto-flush N      TTree::SetAutoFlush: entries, or bytes if negative (-30000000)." << endl;
+}//End method: usage
@@ -1,7 +1,10 @@
 ///////////////////////////////////////////////////////////////////////////
 // This program takes  data, signal, or background files and produces
 //  separate Pt, Eta, Phi, and Mass histograms. This is done for the
-//  large jets and the small jets (Mass is only large jets). The data,
+//  large jets and the small jets (Mass is only large jets), along with
+//  dR12, the dijet mass, HT, the number of small jets, the leading large
+//  jet Pt in sections of dR12 (see DerivedVars.h), and the small jets
+//  matched inside each large jet (see JetMatcher.h). The data,
 //  signal, and background files are passed to the program through
 //  text files. The text files contain the full path to every individual
 //  file of their certain type, so the program reads the file paths line
@@ -9,196 +12,986 @@
 //  each file. When the histograms are made, they are saved to root files.
 //
 //  !!!Make sure the "inputDir" variable is the path to the directory that
-//  contains the text files!!!
+//  contains the text files!!! ("--input-dir DIR" uses DIR instead, e.g.
+//  for the synthetic files of dmcGen.)
 //
-//  This program only handles one case at a time, so it has to be used 
-//  separately for data, signal, and background.
+//  This program only handles one case at a time, so it has to be used
+//  separately for data, signal, and background, unless a sample manifest
+//  is given with "--manifest" (see SampleManifest.h). Then all of the
+//  samples in it are made in one run by the same threads, and each
+//  sample's histograms are saved in their own directory of one root file.
+//
+//  The input files can be processed in parallel with "--threads N". Each
+//  nominal tree is split into ranges of whole ROOT clusters, and threads
+//  that run out of work steal ranges from the others (see WorkStealer.h),
+//  so one very large file doesn't leave the other threads idle. Every
+//  range is filled into its own HistSet and the sets are added up in a
+//  fixed order (see HistMerger in HistSet.h), so the output is bin for
+//  bin the same no matter how many threads are used. With one thread
+//  (the default) every event is filled straight into one set per sample
+//  in entry order instead, so the output is bin for bin the same as the
+//  serial loop always gave (not with "--checkpoint-dir" or "--prescan",
+//  which need the ranges). Adding up the float bins of the ranges rounds
+//  differently from the serial loop, by about 1e-7 of a bin's content.
+//
+//  With "--bulk" the events are read in batches, one branch at a time,
+//  into contiguous arrays (TreeConnector::readBatch) instead of calling
+//  GetEntry on the whole tree for every event. The histograms come out
+//  the same either way; dmcBench compares the speed of the two.
+//
+//  Only the branches TreeConnector connects to are read (all the others
+//  are switched off), and the bytes read from every file are printed at
+//  the end next to the size of the file.
+//
+//  With "--prefetch K" up to K files are opened in the background ahead of
+//  the threads that fill the histograms (see FilePipeline.h), which hides
+//  the latency of opening files on /eos/. Every tree gets a TTreeCache
+//  for just the branches that are read ("--tree-cache MB"). "--open-delay
+//  MS" adds a fake delay to every file open, to try this on local files.
+//
+//  With "--cache-dir DIR" every input file is copied to DIR the first time
+//  it is used and opened from there on later runs (see FileCache.h). The
+//  least recently used copies are deleted when DIR grows past
+//  "--cache-size GB".
+//
+//  With "--write-cache FILE" the values that go into the histograms (the
+//  leading jets and the weight of every event) are also saved in FILE (see
+//  EventCache.h). Running again with the same text file or manifest and
+//  "--from-cache FILE" makes the histograms from FILE alone, without
+//  opening any input file, e.g. to try a different "--nbins".
+//
+//  With "--checkpoint-dir DIR" the histograms of every finished input file
+//  are saved in DIR (see CheckpointStore.h). Running again with the same
+//  options only reads the files that are new or have changed since, and
+//  takes the others from DIR, e.g. after more files were added to the
+//  text file or after a run was killed half way through.
+//
+//  Events can be selected with "--cut EXPR" (see EventSelection.h), given
+//  once for every step of the cutflow, e.g.
+//    --cut "ljet_pt[0] > 300e3" --cut "jet_pt.size() >= 3"
+//  Only the branches a cut needs are read before it is applied, and the
+//  cutflow with the time spent on every cut is printed at the end.
+//
+//  Several regions and weight variations can be made in the same pass
+//  with "--region NAME=CUT" and "--drop-weight FACTOR" (see RegionSet.h).
+//  Every event is read once and filled into each region it is in, once
+//  for every variation, and the histograms are saved in the directory
+//  region/variation.
+//
+//  "--fill-mode shards|atomic|buffered" makes all of the threads fill one
+//  shared set of histograms per sample instead of a HistSet per range (see
+//  ConcurrentHist.h), which uses much less memory when there are many
+//  ranges in flight. The default, "ranges", is the HistSet per range.
+//  The shared sets add up fixed point sums, so they are the same in every
+//  run, and the run stops if a weight is too large or too small for them.
+//
+//  With "--weight-index FILE" the number of entries and the sums of the
+//  weights and squared weights of every input file are kept in FILE (see
+//  WeightIndex.h). Only files that are new or have changed are scanned,
+//  and the sums of every sample are saved next to its histograms as the
+//  parameters "entries", "sumw" and "sumw2", which makePlots uses to
+//  normalise the samples. They are the sums before any selection, so
+//  the parameter "selection" says if "--cut" or "--region" was used.
+//  "--index-only" just updates FILE and prints the sums, without filling
+//  any histograms.
+//
+//  With "--prescan N" every input file is opened first by N threads at once
+//  (see FilePlan.h). Files that are missing or can't be read are listed
+//  and left out instead of stopping the run, empty files are skipped, and
+//  the others are handed to the threads by their expected cost, largest
+//  first ("--plan FILE" saves that work plan).
+//
+//  "--shard I/N" only reads every Nth input file starting at file I (0 to
+//  N-1), counting the files of all the samples together, and saves the
+//  histograms in <sample>.shardIofN.root (or <manifest>.shardIofN.root),
+//  so the N jobs of a batch array each make one part of the output. The
+//  files of "--write-cache", "--plan" and "--weight-index" get the same
+//  tag before their extension, so the jobs never write to the same file.
+//  dmcMerge adds the parts up, and dmcShards runs the N shards as
+//  separate processes on one machine and merges them.
+//
+//  Unless it was built with "make NOSTATS=1", the time spent opening
+//  files, finding trees, reading, decompressing, filling and writing, and
+//  the entries, bytes and events/s of every file, are saved in
+//  <sample>.stats.json next to the histograms (see RunStats.h).
 //
 //  Execute the program with no arguments to show a usage statement.
 ///////////////////////////////////////////////////////////////////////////
 
 
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
 #include "TROOT.h"
 #include "TSystem.h"
 #include "TH1F.h"
 #include "TreeConnector.h"
+#include "HistSet.h"
+#include "WorkStealer.h"
+#include "SampleManifest.h"
+#include "FilePipeline.h"
+#include "FileCache.h"
+#include "EventCache.h"
+#include "CheckpointStore.h"
+#include "ConcurrentHist.h"
+#include "EventSelection.h"
+#include "RegionSet.h"
+#include "WeightIndex.h"
+#include "FilePlan.h"
+#include "RunStats.h"
+#include "TParameter.h"
 
 using namespace std;
 
 void usage();
+int openFile(const TString &path, int fileNum, TFile *&f, TTree *&tree);
+void connectTree(TTree *tree, bool isData, TreeConnector &tc);
+template <class Hists>
+void fillRange(TTree *tree, TreeConnector &tc, Long64_t first, Long64_t last, Hists &hists,
+	       EventBatch *batch, EventCacheBlock *block, EventSelection *selection STATS(, StageClock &clock));
+bool fillFromCache(const string &path, const vector<int> &fileSample, int nThreads, int nbins, HistMerger &merger);
+void saveHists(const vector<Sample> &samples, vector<vector<HistSet*> > &totals, const string &manifestName, const RegionSet *regions,
+	       const WeightIndex *weightIndex, bool selection, const string &tag);
+void writeSlots(TDirectory *dir, vector<vector<HistSet*> > &totals, int sample, const RegionSet *regions);
+void writeWeights(TDirectory *dir, const Sample &sample, const WeightIndex *weightIndex, bool selection);
+
+mutex printLock;     //Keeps the messages of different threads from mixing
+int openDelay = 0;            //Milliseconds of fake latency added to every file open
+Long64_t treeCacheSize = 30000000;   //Bytes of TTreeCache per tree
+FileCache *fileCache = 0;     //Local copies of the input files, if used
+RunStats *runStats = 0;       //Times and counters of the run, unless built without them
 
 
 int main(int argc, char* argv[])
 {
-  if(argc != 2) { usage(); return 1; }
+  int nThreads = 1;
+  Long64_t rangeEntries = 100000;      //Smallest number of entries handed to a thread at once
+  bool bulk = false;                   //Read batches of events branch by branch
+  string sampleName;
+  string manifestName;
+  int prefetch = 0;                    //Files opened ahead in the background
+  string cacheDir;
+  double cacheSize = 100;              //GB the file cache may use
+  string writeCache, fromCache;        //Event cache to make, or to make the histograms from
+  int nbins = 100;                     //Number of bins
+  string checkpointDir;
+  string fillMode = "ranges";          //How the threads fill the histograms
+  vector<string> cuts;                 //Steps of the event selection
+  vector<string> regionArgs, dropWeights;
+  string weightIndexName;
+  bool indexOnly = false;              //Only update the weight index
+  int prescan = 0;                     //Threads that open every file before the run (0 for no pre-scan)
+  string planName;
+  int shard = 0, nShards = 1;          //Part of the input files read by this job
+  //data is "data_15_16.txt", signal is "ttbar.txt", background is "background.txt";
+  string inputDir = "/afs/cern.ch/user/c/cracz/work/DMC/input/";
 
-  gROOT->ProcessLine("#include <vector>"); //Problems occur with the branches of vector<float> without this line
+  for(int a = 1; a < argc; ++a)
+    {
+      string arg(argv[a]);
+
+      if (arg == "--threads" && a+1 < argc) { nThreads = atoi(argv[++a]); }
+      else if (arg == "--range-entries" && a+1 < argc) { rangeEntries = atoll(argv[++a]); }
+      else if (arg == "--bulk") { bulk = true; }
+      else if (arg == "--manifest" && a+1 < argc) { manifestName = argv[++a]; }
+      else if (arg == "--prefetch" && a+1 < argc) { prefetch = atoi(argv[++a]); }
+      else if (arg == "--tree-cache" && a+1 < argc) { treeCacheSize = atoll(argv[++a])*1000000; }
+      else if (arg == "--open-delay" && a+1 < argc) { openDelay = atoi(argv[++a]); }
+      else if (arg == "--cache-dir" && a+1 < argc) { cacheDir = argv[++a]; }
+      else if (arg == "--cache-size" && a+1 < argc) { cacheSize = atof(argv[++a]); }
+      else if (arg == "--write-cache" && a+1 < argc) { writeCache = argv[++a]; }
+      else if (arg == "--from-cache" && a+1 < argc) { fromCache = argv[++a]; }
+      else if (arg == "--nbins" && a+1 < argc) { nbins = atoi(argv[++a]); }
+      else if (arg == "--checkpoint-dir" && a+1 < argc) { checkpointDir = argv[++a]; }
+      else if (arg == "--fill-mode" && a+1 < argc) { fillMode = argv[++a]; }
+      else if (arg == "--cut" && a+1 < argc) { cuts.push_back(argv[++a]); }
+      else if (arg == "--region" && a+1 < argc) { regionArgs.push_back(argv[++a]); }
+      else if (arg == "--drop-weight" && a+1 < argc) { dropWeights.push_back(argv[++a]); }
+      else if (arg == "--weight-index" && a+1 < argc) { weightIndexName = argv[++a]; }
+      else if (arg == "--index-only") { indexOnly = true; }
+      else if (arg == "--prescan" && a+1 < argc) { prescan = atoi(argv[++a]); }
+      else if (arg == "--plan" && a+1 < argc) { planName = argv[++a]; }
+      else if (arg == "--input-dir" && a+1 < argc) { inputDir = argv[++a]; }
+      else if (arg == "--shard" && a+1 < argc)
+	{
+	  if (sscanf(argv[++a], "%d/%d", &shard, &nShards) != 2) { usage(); return 1; }
+	}
+      else if (sampleName.empty() && arg.substr(0, 2) != "--") { sampleName = arg; }
+      else { usage(); return 1; }
+    }
+  if (sampleName.empty() == manifestName.empty() || nThreads < 1 || rangeEntries < 1 || prefetch < 0
+      || nbins < 1 || !(writeCache.empty() || fromCache.empty())
+      || !(writeCache.empty() || checkpointDir.empty())                          //Files from checkpoints would be missing from the event cache
+      || (indexOnly && weightIndexName.empty()) || prescan < 0
+      || (!planName.empty() && prescan == 0)
+      || nShards < 1 || shard < 0 || shard >= nShards) { usage(); return 1; }
+  if (!inputDir.empty() && inputDir[inputDir.size()-1] != '/') inputDir += "/";
+  STATS(Long64_t runStart = StageClock::now());
+
+  ConcurrentHist::Mode sharedMode = ConcurrentHist::kShards;
+  bool shared = (fillMode != "ranges");
+  if ((shared && !ConcurrentHist::parseMode(fillMode, sharedMode))
+      || (shared && !checkpointDir.empty())) { usage(); return 1; }          //Checkpoints need the histograms of every file
+  if (!(fromCache.empty() || cuts.empty())) { usage(); return 1; }         //The cache only has the events that were selected when it was made
+
+  string cutText;                      //All of the cuts, for the checkpoint names
+  for (int c = 0; c < (int)cuts.size(); ++c) cutText += (c > 0 ? " ; " : "") + cuts[c];
+  EventSelection *cutflow = 0;         //Sum of every thread's cutflow
+  try { if (!cuts.empty()) cutflow = new EventSelection(cuts); }
+  catch (invalid_argument &e) { cout << e.what() << endl; return 1; }
+  if (cutflow && bulk) { cout << "--bulk isn't used with --cut, the cuts read events one by one" << endl; bulk = false; }
+
+  RegionSet *regions = 0;              //Only with --region or --drop-weight
+  try { if (!regionArgs.empty() || !dropWeights.empty()) regions = new RegionSet(regionArgs, dropWeights); }
+  catch (invalid_argument &e) { cout << e.what() << endl; return 1; }
+  if (regions && !(fromCache.empty() && checkpointDir.empty())) { usage(); return 1; }   //Both only know one set of histograms per file
+  if (regions && bulk) { cout << "--bulk isn't used with regions, they are filled event by event" << endl; bulk = false; }
+  int nSlots = regions ? regions->nSlots() : 1;      //Sets of histograms per sample, one for each region and variation
 
-  string sampleName(argv[1]);                                    //data is "data_15_16.txt", signal is "ttbar.txt", background is "background.txt";
-  string sampleNoExt(sampleName.substr(0, sampleName.find_last_of(".")));
-  string inputDir = "/afs/cern.ch/user/c/cracz/work/DMC/input/";
- 
+  gROOT->ProcessLine("#include <vector>"); //Problems occur with the branches of vector<float> without this line
+  if (nThreads > 1 || prefetch > 0 || prescan > 1) ROOT::EnableThreadSafety();
 
-  cout << "Accessing text file..." << endl << endl;
-  ifstream str((inputDir+sampleName).c_str());
-  if(str.fail()) { cout << sampleName << " could not be opened!" << endl; return 1; }
+  vector<Sample> samples;
 
 
   cout << "Retrieving root file paths..." << endl << endl;
-  string temp;
-  vector<TString> files;   //Vector of file paths for the samples
-  while(getline(str, temp)) 
+  if (!manifestName.empty())
     {
-      while(temp.size() == 0) { getline(str, temp); }     // This is to skip blank lines
-
-      files.push_back((TString)temp);
+      if (!readManifest(inputDir, manifestName, samples)) return 1;
+    }
+  else
+    {
+      Sample s;
+      s.name = sampleName.substr(0, sampleName.find_last_of("."));
+      s.listFile = sampleName;
+      s.isData = false;               //Decided file by file below, from the file name
+      s.color = 0;
+      s.group = s.name;
+      if (!readFileList(inputDir+sampleName, s.files)) return 1;
+      samples.push_back(s);
     }
-  if (files.size() == 0) { cout << "The text file was empty!" << endl; return 1; }
-
-  const int n_ljet_hists = 2;            //Number of large jet histograms (0 is leading jet, 1 is second leading, etc.)
-  const int n_jet_hists = 3;             //Number of small jet histograms
-  int nbins = 100;                     //Number of bins
-
-  vector<TH1F*> h_ljet_pt(n_ljet_hists), h_ljet_eta(n_ljet_hists), h_ljet_phi(n_ljet_hists), h_ljet_m(n_ljet_hists);
-  vector<TH1F*> h_jet_pt(n_jet_hists), h_jet_eta(n_jet_hists), h_jet_phi(n_jet_hists);
 
-  stringstream ss;
+  string tag;                          //Added to the name of the output file
+  if (nShards > 1)
+    {
+      selectShard(samples, shard, nShards);
+      tag = shardTag(shard, nShards);
+      if (!writeCache.empty()) writeCache = shardPath(writeCache, shard, nShards);
+      if (!planName.empty()) planName = shardPath(planName, shard, nShards);
+      if (!weightIndexName.empty()) weightIndexName = shardPath(weightIndexName, shard, nShards);
+      int nFiles = 0;
+      for (int s = 0; s < (int)samples.size(); ++s) nFiles += samples[s].files.size();
+      cout << "Shard " << shard << " of " << nShards << ": " << nFiles << " files" << endl << endl;
+    }
 
-  for(int i=0; i < n_ljet_hists; ++i)       //Make the empty histograms and number them (using the stringstream)
+  vector<TString> files;   //Vector of file paths for all of the samples
+  vector<int> fileSample;  //Which sample each file belongs to
+  vector<bool> fileIsData;
+  for (int s = 0; s < (int)samples.size(); ++s)
+    for (int i = 0; i < (int)samples[s].files.size(); ++i)
+      {
+	files.push_back(samples[s].files[i]);
+	fileSample.push_back(s);
+	//figure out if weight branches need to be initialized (data has no weights) {{Might need a better way of doing this rather than going by the file's name}}
+	fileIsData.push_back(manifestName.empty() ? samples[s].files[i].Contains("data", TString::kExact) : samples[s].isData);
+      }
+
+  WeightIndex *weightIndex = 0;
+  if (!weightIndexName.empty())
     {
-      ss<<i;
-      string jnum = ss.str();
+      cout << "Updating the weight index..." << endl;
+      weightIndex = new WeightIndex(weightIndexName);
+      if (!weightIndex->update(files, fileIsData, nThreads)) return 1;
+      weightIndex->report();
+      cout << endl;
+    }
+  if (indexOnly)
+    {
+      cout << setprecision(10);
+      for (int s = 0; s < (int)samples.size(); ++s)
+	{
+	  WeightSum sum;
+	  bool complete = weightIndex->sum(samples[s].files, sum);
+	  cout << "  " << setw(20) << left << samples[s].name << right << setw(12) << sum.entries << " entries"
+	       << "   sumw " << setw(16) << sum.sumw << "   sumw2 " << setw(16) << sum.sumw2
+	       << (complete ? "" : "   (incomplete, some files are not in the index)") << endl;
+	}
+      delete weightIndex;
+      return 0;
+    }
 
-      h_ljet_pt[i]  = new TH1F((string("h_ljet_pt")+jnum).c_str(),  (string("Large Jet Pt[")+jnum+string("]")).c_str(),  nbins, 0, 2000000);
-      h_ljet_eta[i] = new TH1F((string("h_ljet_eta")+jnum).c_str(), (string("Large Jet Eta[")+jnum+string("]")).c_str(), nbins, -3, 3);
-      h_ljet_phi[i] = new TH1F((string("h_ljet_phi")+jnum).c_str(), (string("Large Jet Phi[")+jnum+string("]")).c_str(), nbins, -4, 4);
-      h_ljet_m[i]   = new TH1F((string("h_ljet_m")+jnum).c_str(),   (string("Large Jet Mass[")+jnum+string("]")).c_str(), nbins, 0, 250000);
-      ss.str(string());     //Clears the stringstream
+  vector<vector<HistSet*> > totals(nSlots);   //Sum of every file's histograms, for each slot and sample
+  vector<HistMerger*> mergers;                 //One per slot
+  for (int k = 0; k < nSlots; ++k)
+    {
+      for (int s = 0; s < (int)samples.size(); ++s) totals[k].push_back(new HistSet(nbins));
+      mergers.push_back(new HistMerger(fileSample, totals[k]));
     }
-      
-  for(int j=0; j < n_jet_hists; ++j)
+  HistMerger &merger = *mergers[0];            //The only one, without regions
+
+  if (!fromCache.empty())
     {
-      ss<<j;
-      string jnum = ss.str();
+      cout << "Filling histograms from " << fromCache << "..." << endl;
+      if (!fillFromCache(fromCache, fileSample, nThreads, nbins, merger)) return 1;
+      cout << "done" << endl << endl;
+
+      saveHists(samples, totals, manifestName, regions, weightIndex, false, tag);
+      for (int s = 0; s < (int)samples.size(); ++s) delete totals[0][s];
+      delete mergers[0];
 
-      h_jet_pt[j]  = new TH1F((string("h_jet_pt")+jnum).c_str(),  (string("Pt[")+jnum+string("]")).c_str(),  nbins, 0, 2000000);
-      h_jet_eta[j] = new TH1F((string("h_jet_eta")+jnum).c_str(), (string("Eta[")+jnum+string("]")).c_str(), nbins, -3, 3);
-      h_jet_phi[j] = new TH1F((string("h_jet_phi")+jnum).c_str(), (string("Phi[")+jnum+string("]")).c_str(),  nbins, -4, 4);
-      ss.str(string());     //Clears the stringstream
+      cout << "Finished" << endl;
+      return 0;
     }
 
+  if (!cacheDir.empty()) fileCache = new FileCache(cacheDir, (Long64_t)(cacheSize*1e9));
 
+  EventCacheWriter *cacheWriter = 0;
+  if (!writeCache.empty())
+    {
+      cacheWriter = new EventCacheWriter;
+      if (!cacheWriter->open(writeCache, files.size())) return 1;
+    }
 
-  TFile *f = 0;  
-  TTree *tree = 0;
-  TreeConnector tc;
-  
-  cout << "Accessing files and filling histograms...";
+  CheckpointStore *checkpoints = 0;
+  if (!checkpointDir.empty()) checkpoints = new CheckpointStore(checkpointDir, nbins, rangeEntries, cutText);
+  bool serial = (nThreads == 1 && !shared && !checkpoints && prescan == 0);   //Fill the totals in entry order, without the merger
 
-  for(int i = 0; i < files.size(); ++i)
+  vector<int> toRead;                 //Files that aren't taken from checkpoints
+  for (int i = 0; i < (int)files.size(); ++i)
     {
-      if(gSystem->AccessPathName(files[i])) 
-	{ 
-	  cout << "File " << i+1 << " could not be found!" << endl
-	       << files[i] << endl; 
-	  return 1; 
+      HistSet *saved = 0;
+      if (checkpoints && checkpoints->load(files[i], fileIsData[i], saved))   //Already done in an earlier run
+	{
+	  merger.setParts(i, saved ? 1 : 0);
+	  if (saved) merger.addPart(i, 0, saved);
+	  continue;
 	}
+      toRead.push_back(i);
+    }
 
-      f = TFile::Open(files[i], "READ");
+  vector<vector<ConcurrentHistSet*> > sharedHists(nSlots);    //One per slot and sample, with --fill-mode
+  if (shared)
+    for (int k = 0; k < nSlots; ++k)
+      for (int s = 0; s < (int)samples.size(); ++s) sharedHists[k].push_back(new ConcurrentHistSet(*totals[k][s], sharedMode, nThreads));
 
-      if (f->GetSize() < 1) { f->Close(); continue; }                             //Skip the file if it is empty or can't be read
+  auto setParts = [&](int fileNum, int nParts)
+    {
+      for (int k = 0; k < nSlots; ++k) mergers[k]->setParts(fileNum, nParts);
+    };
 
-      tc.getTree(f, tree, "nominal"); 
-      if (!tree) { std::cout << "Nominal tree not found!" << std::endl; return 1; }
-      if (tree->GetEntries() == 0) { continue; }                                 //Skip the file if there are no entries
-      
-      if (files[i].Contains("data", TString::kExact)) tc.setAsData();                //figure out if weight branches need to be initialized (data has no weights) {{Might need a better way of doing this rather than going by the file's name}}
-      else tc.setAsMC();
+  vector<char> leftOut(files.size(), 0);   //Skipped because they couldn't be read, not because they are empty
+  if (checkpoints)                         //Only empty files get a "skipped" checkpoint, the others are tried again next time
+    merger.onFileDone([&](int fileNum, const HistSet *sum) { if (sum || !leftOut[fileNum]) checkpoints->save(files[fileNum], fileIsData[fileNum], sum); });
 
-      
-      tc.init(tree);                                        //Initialize connections to the branches inside 'tree'
+  WorkStealer queue(nThreads);
+  vector<int> openOrder;               //Files in the order they are started
+  if (prescan > 0)
+    {
+      cout << "Pre-scanning " << toRead.size() << " files with " << prescan << " threads..." << endl;
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      vector<FileInfo> info;
+      scanFiles(files, toRead, fileIsData, prescan, openDelay, info);
+      double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      cout << "done in " << fixed << setprecision(2) << seconds << " s" << endl;
+      cout.unsetf(ios::fixed);
+      cout << setprecision(6);
+
+      reportBadFiles(files, toRead, info);
+      vector<int> good;
+      for (int n = 0; n < (int)toRead.size(); ++n)
+	if (info[toRead[n]].status == FileInfo::kGood) good.push_back(toRead[n]);
+	else
+	  {
+	    leftOut[toRead[n]] = (info[toRead[n]].status != FileInfo::kEmpty);
+	    setParts(toRead[n], 0);                   //Left out, the same as a skipped file
+	  }
+
+      WorkPlan plan(info, good, nThreads);
+      plan.report();
+      if (!planName.empty() && !plan.write(planName, files)) cout << planName << " could not be written!" << endl;
+      cout << endl;
+
+      for (int n = 0; n < (int)plan.order().size(); ++n)
+	{
+	  EntryRange wholeFile = { plan.order()[n], 0, 0, -1 };
+	  queue.push(plan.worker(wholeFile.fileNum), wholeFile);
+	}
+      openOrder = plan.order();
+    }
+  else
+    {
+      for (int n = 0; n < (int)toRead.size(); ++n)
+	{
+	  EntryRange wholeFile = { toRead[n], 0, 0, -1 };
+	  queue.push(n % nThreads, wholeFile);        //Deal the files out, they get split once they're opened
+	}
+      openOrder = toRead;
+    }
 
+  atomic<bool> failed(false);
+  STATS(bool watchIO = (nThreads == 1 && prefetch == 0));      //TTreePerfStats can't be used on several threads at once
+  STATS(runStats = new RunStats(files, watchIO));
 
-      Float_t totalWeight = 1.0;
-      Int_t nentries = tree->GetEntries();
+  FilePipeline *pipeline = 0;
+  if (prefetch > 0)
+    pipeline = new FilePipeline(files.size(), prefetch,
+				[&](int fileNum, TFile *&f, TTree *&tree) { return openFile(files[fileNum], fileNum, f, tree); }, openOrder);
 
-      for (Long64_t j=0; j<nentries; ++j)
-	{
-	  tree->GetEntry(j);
-	  
-	  if(!tc.isData()) { totalWeight = tc.weight_mc*tc.weight_pileup*tc.weight_leptonSF*tc.weight_jvt; }
- 
+  vector<Long64_t> bytesRead(files.size(), 0), fileSize(files.size(), 0);
+  mutex statsLock;
 
-	  for(int nlj = 0; nlj < n_ljet_hists; ++nlj)
+  auto closeInput = [&](TFile *&f, int fileNum)      //Keeps track of the bytes read before closing
+    {
+      if (!f) return;
+      lock_guard<mutex> guard(statsLock);
+      bytesRead[fileNum] += f->GetBytesRead();
+      fileSize[fileNum] = f->GetSize();
+      delete f; f = 0;
+    };
+
+  cout << "Accessing files and filling histograms";
+  if (samples.size() > 1) cout << " for " << samples.size() << " samples";
+  if (nThreads > 1) cout << " with " << nThreads << " threads";
+  cout << "..." << endl;
+
+  auto worker = [&](int w)
+    {
+      TreeConnector tc;                //Every thread connects to its own trees
+      TFile *f = 0;
+      TTree *tree = 0;
+      int openNum = -1;                //Index of the file that is open now
+      EventBatch batch;                //Only used with --bulk
+      EventCacheBlock block;           //Only used with --write-cache
+      EventSelection *selection = cutflow ? new EventSelection(cuts) : 0;
+      EntryRange range;
+      STATS(StageClock clock);         //The probes, compiled out with NOSTATS=1
+
+      while (queue.next(w, range))
+	{
+	  if (range.fileNum != openNum)
 	    {
-	      if(tc.ljet_pt->size() > nlj)
+	      STATS(clock.unwatch());
+	      closeInput(f, openNum); tree = 0; openNum = -1;
+
+	      int status = (pipeline && range.last < 0) ? pipeline->take(range.fileNum, f, tree)
+		                                        : openFile(files[range.fileNum], range.fileNum, f, tree);
+	      if (status > 0 && range.last < 0)
+		{
+		  leftOut[range.fileNum] = (status == 2);
+		  setParts(range.fileNum, 0);
+		  queue.finished(w);
+		  continue;
+		}
+	      if (status != 0) { closeInput(f, range.fileNum); failed = true; queue.stop(); queue.finished(w); break; }
+
+	      STATS(clock.start());
+	      connectTree(tree, fileIsData[range.fileNum], tc);
+	      STATS(clock.lap(StageClock::kGetTree));
+	      STATS(if (watchIO) clock.watch(tree));
+	      openNum = range.fileNum;
+
+	      try
+		{
+		  if (selection) selection->connect(tc);
+		  if (regions) regions->check(tc);
+		}
+	      catch (invalid_argument &e)
 		{
-		  h_ljet_pt[nlj]->Fill(tc.ljet_pt->at(nlj),   totalWeight);
-		  h_ljet_eta[nlj]->Fill(tc.ljet_eta->at(nlj), totalWeight);
-		  h_ljet_phi[nlj]->Fill(tc.ljet_phi->at(nlj), totalWeight);
-		  h_ljet_m[nlj]->Fill(tc.ljet_m->at(nlj),     totalWeight);
+		  lock_guard<mutex> guard(printLock);
+		  cout << e.what() << endl;
+		  failed = true; queue.stop(); queue.finished(w); break;
 		}
 	    }
 
+	  if (range.last < 0)          //First look at this file: split it and keep the other ranges close by
+	    {
+	      vector<EntryRange> ranges = WorkStealer::split(tree, range.fileNum, rangeEntries);
+	      setParts(range.fileNum, ranges.size());
+	      for (int r = ranges.size()-1; r > 0; --r) queue.pushFront(w, ranges[r]);
+	      range = ranges[0];
+	    }
 
-	  for(int nj = 0; nj < n_jet_hists; ++nj)
+	  block.clear();
+	  STATS(Long64_t busy = clock.ticks[StageClock::kRead] + clock.ticks[StageClock::kFill]);
+	  vector<HistSet*> parts;          //Given to the mergers once they are filled, without --fill-mode
+	  try
 	    {
-	      if(tc.jet_pt->size() > nj)
+	      if (shared)
+		{
+		  vector<ConcurrentHistSet::Filler> fillers;
+		  vector<ConcurrentHistSet::Filler*> slots;
+		  for (int k = 0; k < nSlots; ++k) fillers.push_back(ConcurrentHistSet::Filler(*sharedHists[k][fileSample[range.fileNum]], w));
+		  for (int k = 0; k < nSlots; ++k) slots.push_back(&fillers[k]);
+
+		  if (regions)
+		    {
+		      RegionFiller<ConcurrentHistSet::Filler> regionFiller(*regions, slots);
+		      fillRange(tree, tc, range.first, range.last, regionFiller, (EventBatch*)0, cacheWriter ? &block : 0, selection STATS(, clock));
+		    }
+		  else fillRange(tree, tc, range.first, range.last, fillers[0], bulk ? &batch : 0, cacheWriter ? &block : 0, selection STATS(, clock));
+		}
+	      else if (serial)
+		{
+		  vector<SerialFiller> fillers;
+		  vector<SerialFiller*> slots;
+		  for (int k = 0; k < nSlots; ++k) fillers.push_back(SerialFiller(*totals[k][fileSample[range.fileNum]]));
+		  for (int k = 0; k < nSlots; ++k) slots.push_back(&fillers[k]);
+
+		  if (regions)
+		    {
+		      RegionFiller<SerialFiller> regionFiller(*regions, slots);
+		      fillRange(tree, tc, range.first, range.last, regionFiller, (EventBatch*)0, cacheWriter ? &block : 0, selection STATS(, clock));
+		    }
+		  else fillRange(tree, tc, range.first, range.last, fillers[0], bulk ? &batch : 0, cacheWriter ? &block : 0, selection STATS(, clock));
+		}
+	      else
 		{
-		  h_jet_pt[nj]->Fill(tc.jet_pt->at(nj),   totalWeight);
-		  h_jet_eta[nj]->Fill(tc.jet_eta->at(nj), totalWeight);
-		  h_jet_phi[nj]->Fill(tc.jet_phi->at(nj), totalWeight);
+		  for (int k = 0; k < nSlots; ++k) parts.push_back(new HistSet(nbins));
+
+		  if (regions)
+		    {
+		      RegionFiller<HistSet> regionFiller(*regions, parts);
+		      fillRange(tree, tc, range.first, range.last, regionFiller, (EventBatch*)0, cacheWriter ? &block : 0, selection STATS(, clock));
+		    }
+		  else fillRange(tree, tc, range.first, range.last, *parts[0], bulk ? &batch : 0, cacheWriter ? &block : 0, selection STATS(, clock));
 		}
 	    }
-	  
+	  catch (exception &e)        //readBatch found jet branches of different lengths, or the shared sums overflowed
+	    {
+	      for (int k = 0; k < (int)parts.size(); ++k) delete parts[k];
+	      lock_guard<mutex> guard(printLock);
+	      cout << "File " << range.fileNum+1 << ": " << e.what() << endl;
+	      failed = true; queue.stop(); queue.finished(w); break;
+	    }
+	  for (int k = 0; k < (int)parts.size(); ++k) mergers[k]->addPart(range.fileNum, range.part, parts[k]);
+	  STATS(runStats->addRange(range.fileNum, range.last - range.first,
+				   (clock.ticks[StageClock::kRead] + clock.ticks[StageClock::kFill] - busy)*1e-9));
+	  if (cacheWriter) cacheWriter->write(fileSample[range.fileNum], range.fileNum, range.part, block);
+	  queue.finished(w);
+	}
+
+      STATS(clock.unwatch());
+      closeInput(f, openNum);
+      STATS(runStats->add(clock));
+
+      if (selection)
+	{
+	  lock_guard<mutex> guard(statsLock);
+	  cutflow->add(*selection);
+	  delete selection;
 	}
+    };
 
-      f->Close();
+  if (nThreads == 1) worker(0);
+  else
+    {
+      vector<thread> pool;
+      for (int t = 0; t < nThreads; ++t) pool.push_back(thread(worker, t));
+      for (int t = 0; t < nThreads; ++t) pool[t].join();
     }
 
+  delete pipeline;
+  if (failed) { delete cacheWriter; return 1; }     //Leaves the event cache incomplete, so it can't be used
+  if (serial)
+    for (int k = 0; k < nSlots; ++k)
+      for (int s = 0; s < (int)samples.size(); ++s) totals[k][s]->flush();
+
+  if (cacheWriter)
+    {
+      if (!cacheWriter->close()) { cout << writeCache << " could not be written!" << endl; return 1; }
+      delete cacheWriter;
+    }
 
   cout << "done" << endl << endl;
+  if (fileCache) { fileCache->report(); cout << endl; }
+  if (checkpoints) { checkpoints->report(); cout << endl; }
+
+  if (shared)
+    {
+      size_t bytes = 0;
+      for (int k = 0; k < nSlots; ++k)
+	for (int s = 0; s < (int)samples.size(); ++s)
+	  {
+	    sharedHists[k][s]->copyTo(*totals[k][s]);
+	    bytes += sharedHists[k][s]->bytes();
+	    delete sharedHists[k][s];
+	  }
+      cout << "Shared histograms (" << fillMode << ", " << nThreads << " threads): "
+	   << fixed << setprecision(2) << bytes/1e6 << " MB" << endl << endl;
+      cout.unsetf(ios::fixed);
+      cout << setprecision(6);
+    }
+  queue.report();
+  cout << endl;
+  if (cutflow) { cutflow->report(); cout << endl; delete cutflow; }
+
+  cout << "Bytes read per file:" << endl;
+  Long64_t totalRead = 0, totalSize = 0;
+  for (int i = 0; i < (int)files.size(); ++i)
+    {
+      if (fileSize[i] == 0) continue;                //Skipped
+      totalRead += bytesRead[i]; totalSize += fileSize[i];
+      cout << "  file " << setw(5) << i+1 << fixed << setprecision(1)
+	   << setw(10) << bytesRead[i]/1e6 << " MB of " << setw(10) << fileSize[i]/1e6 << " MB"
+	   << "  (" << setw(5) << 100.0*bytesRead[i]/fileSize[i] << "%)" << endl;
+    }
+  if (totalSize > 0)
+    cout << "  total     " << setw(10) << totalRead/1e6 << " MB of " << setw(10) << totalSize/1e6 << " MB"
+	 << "  (" << setw(5) << 100.0*totalRead/totalSize << "%)" << endl;
+  cout.unsetf(ios::fixed);
+  cout << setprecision(6) << endl;
 
 
   //SAVE ROOT FILES
-  cout << "Saving histograms in " << sampleNoExt << ".root ..." << endl;
+  STATS(Long64_t writeStart = StageClock::now());
+  saveHists(samples, totals, manifestName, regions, weightIndex, !cuts.empty() || regions, tag);
+  STATS(runStats->addWrite((StageClock::now() - writeStart)*1e-9));
+
+  STATS(
+    for (int i = 0; i < (int)files.size(); ++i) runStats->setBytes(i, bytesRead[i], fileSize[i]);
+    string statsName = (manifestName.empty() ? samples[0].name : manifestName.substr(0, manifestName.find_last_of("."))) + tag + ".stats.json";
+    string mode = string(bulk ? "bulk" : "getentry") + ", " + fillMode;
+    if (runStats->write(statsName, manifestName.empty() ? samples[0].name : manifestName, nThreads, mode, (StageClock::now() - runStart)*1e-9))
+      cout << "Run report saved in " << statsName << endl;
+    else cout << statsName << " could not be written!" << endl;
+    delete runStats;
+  )
+
+  for (int k = 0; k < nSlots; ++k)
+    {
+      for (int s = 0; s < (int)samples.size(); ++s) delete totals[k][s];
+      delete mergers[k];
+    }
+  delete regions;
+  delete weightIndex;
+
+
+  cout << "Finished" << endl;
+  return 0;
+}//End main
+
+
+/*
+  Saves the histograms of every sample: in <sample>.root for a single text
+  file, or in one directory per sample of <manifest>.root. With a weight
+  index, the sums of the weights of each sample are saved with it. tag is
+  added to the name of the file (for shards).
+*/
+void saveHists(const vector<Sample> &samples, vector<vector<HistSet*> > &totals, const string &manifestName, const RegionSet *regions,
+	       const WeightIndex *weightIndex, bool selection, const string &tag)
+{
+  if (manifestName.empty())
+    {
+      string sampleNoExt(samples[0].name + tag);
+      cout << "Saving histograms in " << sampleNoExt << ".root ..." << endl;
+
+      TString newFileName(sampleNoExt+".root");
+      TFile *h_file = TFile::Open(newFileName, "RECREATE");
+
+      writeSlots(h_file, totals, 0, regions);
+      writeWeights(h_file, samples[0], weightIndex, selection);
+
+      h_file->Close();
+    }
+  else
+    {
+      string manifestNoExt(manifestName.substr(0, manifestName.find_last_of(".")) + tag);
+      cout << "Saving histograms in " << manifestNoExt << ".root ..." << endl;
+
+      TString newFileName(manifestNoExt+".root");
+      TFile *h_file = TFile::Open(newFileName, "RECREATE");
+
+      for (int s = 0; s < (int)samples.size(); ++s)   //One directory per sample, titled with its group
+	{
+	  TDirectory *dir = h_file->mkdir(samples[s].name.c_str(), samples[s].group.c_str());
+	  writeSlots(dir, totals, s, regions);
+	  dir->cd();
+	  TParameter<int> color("color", samples[s].color);
+	  TParameter<bool> isData("isData", samples[s].isData);
+	  color.Write();
+	  isData.Write();
+	  writeWeights(dir, samples[s], weightIndex, selection);
+	}
+
+      h_file->Close();
+    }
+}//End method: saveHists
 
 
-  TString newFileName(sampleNoExt+".root");
-  TFile *h_file = TFile::Open(newFileName, "RECREATE"); h_file->cd();
+/*
+  Writes the histograms of one sample into dir, or into dir/region/variation
+  for every slot when there are regions
+*/
+void writeSlots(TDirectory *dir, vector<vector<HistSet*> > &totals, int sample, const RegionSet *regions)
+{
+  if (!regions) { totals[0][sample]->write(dir); return; }
 
-  for(int i=0; i < n_ljet_hists; ++i)
+  for (int k = 0; k < regions->nSlots(); ++k)
     {
-      h_ljet_pt[i]->Write(h_ljet_pt[i]->GetName());
-      h_ljet_eta[i]->Write(h_ljet_eta[i]->GetName());
-      h_ljet_phi[i]->Write(h_ljet_phi[i]->GetName());
-      h_ljet_m[i]->Write(h_ljet_m[i]->GetName());
+      TDirectory *regionDir = dir->GetDirectory(regions->regionName(k).c_str());
+      if (!regionDir) regionDir = dir->mkdir(regions->regionName(k).c_str());
+      totals[k][sample]->write(regionDir->mkdir(regions->variationName(k).c_str()));
     }
+}//End method: writeSlots
+
 
-  for(int j=0; j < n_jet_hists; ++j)
+/*
+  Writes the number of entries and the sums of the weights of a sample's
+  files into dir (nothing without a weight index, or if any of the files
+  isn't in it, so an incomplete sum is never used to normalise), and if
+  the histograms were made with a selection
+*/
+void writeWeights(TDirectory *dir, const Sample &sample, const WeightIndex *weightIndex, bool selection)
+{
+  if (!weightIndex) return;
+
+  WeightSum sum;
+  if (!weightIndex->sum(sample.files, sum))
     {
-      h_jet_pt[j]->Write(h_jet_pt[j]->GetName());
-      h_jet_eta[j]->Write(h_jet_eta[j]->GetName());
-      h_jet_phi[j]->Write(h_jet_phi[j]->GetName());
+      cout << "Not every file of " << sample.name << " is in the weight index, its sumw is not saved!" << endl;
+      return;
+    }
+  dir->cd();
+  TParameter<Long64_t> entries("entries", sum.entries);
+  TParameter<double> sumw("sumw", sum.sumw);
+  TParameter<double> sumw2("sumw2", sum.sumw2);
+  entries.Write();
+  sumw.Write();
+  sumw2.Write();
+  TParameter<bool> selected("selection", selection);
+  selected.Write();
+}//End method: writeWeights
+
+
+/*
+  Opens one input file and finds its nominal tree. Returns 0 when the tree
+  is ready, 1 when the file should be skipped (empty), 2 when it should be
+  skipped because it couldn't be opened (this time), and -1 when the run
+  has to stop. This can run on any thread.
+*/
+int openFile(const TString &path, int fileNum, TFile *&f, TTree *&tree)
+{
+  if(gSystem->AccessPathName(path))
+    {
+      lock_guard<mutex> guard(printLock);
+      cout << "File " << fileNum+1 << " could not be found!" << endl
+	   << path << endl;
+      return -1;
     }
 
-  h_file->Close();
+  bool cached = false;
+  TString openPath = fileCache ? fileCache->localPath(path, cached) : path;
 
+  STATS(Long64_t openStart = StageClock::now());
+  if (openDelay > 0 && !cached) this_thread::sleep_for(chrono::milliseconds(openDelay));   //Only local copies are fast
 
-  cout << "Finished" << endl;
+  f = TFile::Open(openPath, "READ");
+  if (!f && openPath != path) f = TFile::Open(path, "READ");                //The copy was evicted in the meantime
+  STATS(Long64_t openEnd = StageClock::now());
+
+  if (!f)                                                                 //Skip the file if it can't be read
+    {
+      lock_guard<mutex> guard(printLock);
+      cout << "File " << fileNum+1 << " could not be opened, it is left out!" << endl;
+      STATS(if (runStats) runStats->fileSkipped(fileNum));
+      return 2;
+    }
+  if (f->GetSize() < 1)                                                   //or if it is empty
+    {
+      delete f; f = 0;
+      STATS(if (runStats) runStats->fileSkipped(fileNum));
+      return 1;
+    }
+
+  TreeConnector finder;
+  tree = 0;
+  finder.getTree(f, tree, "nominal");
+  if (!tree)
+    {
+      lock_guard<mutex> guard(printLock);
+      std::cout << "Nominal tree not found!" << std::endl;
+      delete f; f = 0;
+      return -1;
+    }
+  if (tree->GetEntries() == 0)                                            //Skip the file if there are no entries
+    {
+      delete f; f = 0; tree = 0;
+      STATS(if (runStats) runStats->fileSkipped(fileNum));
+      return 1;
+    }
+
+  STATS(if (runStats) runStats->fileOpened(fileNum, (openEnd - openStart)*1e-9, (StageClock::now() - openEnd)*1e-9));
   return 0;
-}//End main
+}//End method: openFile
+
+
+/*
+  Connects tc to the branches of tree and sets up the TTreeCache for them
+*/
+void connectTree(TTree *tree, bool isData, TreeConnector &tc)
+{
+  if (isData) tc.setAsData();
+  else tc.setAsMC();
+
+
+  tc.init(tree);                                        //Initialize connections to the branches inside 'tree'
+
+  if (treeCacheSize > 0) tc.setupCache(treeCacheSize);
+}//End method: connectTree
+
+
+/*
+  Fills hists (a HistSet or a ConcurrentHistSet::Filler) with the entries
+  [first, last) of the tree tc is connected to. When a batch is given the
+  entries are read in blocks with readBatch, otherwise with GetEntry one
+  event at a time (or cut by cut, when there is a selection). The events
+  are also added to block, if one is given.
+*/
+template <class Hists>
+void fillRange(TTree *tree, TreeConnector &tc, Long64_t first, Long64_t last, Hists &hists,
+	       EventBatch *batch, EventCacheBlock *block, EventSelection *selection STATS(, StageClock &clock))
+{
+  const Long64_t batchSize = 10000;
+  STATS(clock.start());
+
+  if (batch)
+    {
+      for (Long64_t j=first; j<last; j+=batchSize)
+	{
+	  tc.readBatch(j, (last-j < batchSize ? last : j+batchSize), *batch);
+	  STATS(clock.lap(StageClock::kRead));
+	  hists.fillBatch(*batch);
+	  if (block) block->add(*batch);
+	  STATS(clock.lap(StageClock::kFill));
+	}
+      hists.flush();
+      STATS(clock.lap(StageClock::kFill));
+      return;
+    }
+
+  Float_t totalWeight = 1.0;
+
+  for (Long64_t j=first; j<last; ++j)
+    {
+      if (selection) { if (!selection->select(j)) continue; }
+      else tree->GetEntry(j);
+      STATS(clock.lap(StageClock::kRead));
+
+      if(!tc.isData()) { totalWeight = tc.weight_mc*tc.weight_pileup*tc.weight_leptonSF*tc.weight_jvt; }
+
+      hists.fill(tc, totalWeight);
+      if (block) block->add(tc, totalWeight);
+      STATS(clock.lap(StageClock::kFill));
+    }
+  hists.flush();
+  STATS(clock.lap(StageClock::kFill));
+}//End method: fillRange
+
+
+/*
+  Fills the histograms from an event cache written by an earlier run. Every
+  block is filled into its own HistSet and handed to the merger just like a
+  range of an input file, so the result is the same as that run's.
+*/
+bool fillFromCache(const string &path, const vector<int> &fileSample, int nThreads, int nbins, HistMerger &merger)
+{
+  EventCacheReader reader;
+  if (!reader.open(path)) return false;
+
+  if (reader.nFiles() != (int)fileSample.size())
+    {
+      cout << path << " was made from " << reader.nFiles() << " files, not " << fileSample.size() << "!" << endl;
+      return false;
+    }
+
+  vector<int> nParts(fileSample.size(), 0);
+  for (int b = 0; b < reader.nBlocks(); ++b)
+    {
+      const EventCache::BlockInfo &info = reader.block(b);
+      if (info.fileNum < 0 || info.fileNum >= (int)fileSample.size() || info.sample != fileSample[info.fileNum])
+	{
+	  cout << path << " was made from a different text file or manifest!" << endl;
+	  return false;
+	}
+      ++nParts[info.fileNum];
+    }
+  for (int i = 0; i < (int)fileSample.size(); ++i) merger.setParts(i, nParts[i]);   //Files without blocks were skipped
+
+  atomic<int> nextBlock(0);
+  auto worker = [&]()
+    {
+      int b;
+      while ((b = nextBlock++) < reader.nBlocks())
+	{
+	  HistSet *hists = new HistSet(nbins);
+	  reader.fill(b, *hists);
+	  merger.addPart(reader.block(b).fileNum, reader.block(b).part, hists);
+	}
+    };
+
+  if (nThreads == 1) worker();
+  else
+    {
+      vector<thread> pool;
+      for (int t = 0; t < nThreads; ++t) pool.push_back(thread(worker));
+      for (int t = 0; t < nThreads; ++t) pool[t].join();
+    }
+
+  return merger.complete();
+}//End method: fillFromCache
 
 
 void usage()
 {
-  cout << "Usage: dmcHist [textFileName]" << endl << endl
+  cout << "Usage: dmcHist [--threads N] [--range-entries N] [--bulk] [textFileName]" << endl
+       << "       dmcHist [--threads N] [--range-entries N] [--bulk] --manifest [manifestFile]" << endl << endl
        << "The text file should be one that contains the full "
        << "path and file name to every file of a certain type "
        << "(data, signal, background), with each on a separate line."
-       << endl;
+       << endl << endl
+       << "--threads N         Fill histograms with N threads (default 1)." << endl
+       << "--range-entries N   Split the trees into ranges of at least N entries" << endl
+       << "                    that idle threads can steal (default 100000)." << endl
+       << "--bulk              Read the branches in batches of events instead of" << endl
+       << "                    calling GetEntry for every event." << endl
+       << "--manifest FILE     Make every sample listed in FILE in one run (see" << endl
+       << "                    SampleManifest.h), saved in FILE's name with .root." << endl
+       << "--prefetch K        Open up to K files ahead in the background (default 0)." << endl
+       << "--tree-cache MB     TTreeCache size for the branches that are read (default 30)." << endl
+       << "--open-delay MS     Add MS milliseconds to every file open (for testing)." << endl
+       << "--cache-dir DIR     Keep local copies of the input files in DIR." << endl
+       << "--cache-size GB     Most space the copies may use (default 100)." << endl
+       << "--nbins N           Number of bins of every histogram (default 100)." << endl
+       << "--write-cache FILE  Also save the values that are histogrammed in FILE." << endl
+       << "--from-cache FILE   Make the histograms from FILE instead of the input" << endl
+       << "                    files (use the same textFileName or manifest)." << endl
+       << "--checkpoint-dir DIR" << endl
+       << "                    Save every finished file's histograms in DIR and" << endl
+       << "                    reuse them instead of reading the file again." << endl
+       << "--fill-mode MODE    ranges (a HistSet per range, default), or one shared set" << endl
+       << "                    per sample filled with shards, atomic, or buffered." << endl
+       << "--cut EXPR          Only fill events passing EXPR, e.g. \"ljet_pt[0] > 300e3\"" << endl
+       << "                    (give it again for every step of the cutflow)." << endl
+       << "--region NAME=CUT   Fill region NAME with the events passing CUT, saved in" << endl
+       << "                    NAME/ (give it again for every region, all are filled" << endl
+       << "                    in one pass)." << endl
+       << "--drop-weight W     Also fill every region with weight factor W left out," << endl
+       << "                    e.g. weight_pileup (saved in no_W/ next to nominal/)." << endl
+       << "--weight-index FILE Keep the entries and sums of weights of every input file" << endl
+       << "                    in FILE and save each sample's sums with its histograms." << endl
+       << "--index-only        Only update the weight index and print the sums." << endl
+       << "--prescan N         Open every file with N threads first: bad files are" << endl
+       << "                    listed and left out, and the rest are handed out by cost." << endl
+       << "--plan FILE         Save the work plan of --prescan in FILE." << endl
+       << "--input-dir DIR     Directory of the text files (instead of inputDir)." << endl
+       << "--shard I/N         Only read every Nth file starting at file I (0 to N-1)," << endl
+       << "                    and save the histograms in <name>.shardIofN.root." << endl;
 
 }//End method: usage
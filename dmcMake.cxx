@@ -13,6 +13,14 @@
 //  file, so all the user has to do is specify which histogram
 //  needs to be made.
 //
+// With "--all" every histogram that is in all of the files is made in one
+//  run instead: each file is opened once, all of its histograms are read
+//  into memory, and then every stack is drawn from memory. "--match GLOB"
+//  (e.g. 'h_ljet_*', can be given more than once) only makes the
+//  histograms whose names match. With "--workers N" the plots are drawn by
+//  N forked processes (ROOT graphics can't be used from several threads),
+//  which all share the histograms that were read before the fork.
+//
 //  !!!Make sure the "inputDir" variable is the path to the directory that
 //  contains the text files!!!
 ///////////////////////////////////////////////////////////////////////////
@@ -22,9 +30,14 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <cstdlib>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "TSystem.h"
 #include "TROOT.h"
 #include "TFile.h"
+#include "TKey.h"
 #include "TCanvas.h"
 #include "TLegend.h"
 #include "TH1F.h"
@@ -34,11 +47,20 @@
 
 using namespace std;
 
+struct HistFile                     //The histograms of one file of hist_output.txt
+{
+  TString groupName;                //ttbar, background, or data
+  map<TString, TH1*> hists;
+};
+
 void usage();
+bool loadFiles(const vector<TString> &files, const vector<TString> &names, vector<HistFile> &loaded);
+void drawStack(const TString &histName, const vector<HistFile> &loaded, TCanvas *canvas,
+	       map<TString, TString> &title, map<TString, TString> &group, map<TString, Int_t> &color);
 
 int main(int argc, char* argv[])
 {
-  if (argc != 2) { usage(); return 1; }
+  if (argc < 2) { usage(); return 1; }
 
   map<TString, TString> title;                        //maps are used to specify titles and colors
   title["h_ljet_pt0"]  = "First Large Jet p_{T}";
@@ -68,75 +90,202 @@ int main(int argc, char* argv[])
   color["ttbar"] = 44;
   color["background"] = 38;
   color["data"]  = 1;
-  
 
 
-  TString histName(argv[1]);
+  bool all = false;                   //Make every histogram
+  vector<string> patterns;            //Only the ones matching these, with --all
+  int nWorkers = 1;
+  TString histName;
+
+  for (int a = 1; a < argc; ++a)
+    {
+      string arg(argv[a]);
+
+      if (arg == "--all") { all = true; }
+      else if (arg == "--match" && a+1 < argc) { patterns.push_back(argv[++a]); }
+      else if (arg == "--workers" && a+1 < argc) { nWorkers = atoi(argv[++a]); }
+      else if (histName.IsNull() && arg.substr(0, 2) != "--") { histName = arg; }
+      else { usage(); return 1; }
+    }
+  if (all == !histName.IsNull() || nWorkers < 1 || (!all && (!patterns.empty() || nWorkers > 1))) { usage(); return 1; }
   //string sampleName(argv[2]);
   //string sampleNoExt(sampleName.substr(0, sampleName.find_last_of(".")));
 
-  static const TString arr[] = {"h_ljet_pt0", "h_ljet_pt1", "h_ljet_eta0", "h_ljet_eta1", "h_ljet_phi0", "h_ljet_phi1", "h_ljet_m0", "h_ljet_m1", 
+  static const TString arr[] = {"h_ljet_pt0", "h_ljet_pt1", "h_ljet_eta0", "h_ljet_eta1", "h_ljet_phi0", "h_ljet_phi1", "h_ljet_m0", "h_ljet_m1",
 				"h_jet_pt0", "h_jet_pt1", "h_jet_pt2", "h_jet_eta0", "h_jet_eta1", "h_jet_eta2", "h_jet_phi0", "h_jet_phi1", "h_jet_phi2"};
   vector<TString> names (arr, arr + sizeof(arr) / sizeof(arr[0]) );
 
-  bool nameFound = false;
-  for(int i=0; i<names.size(); ++i)
-    { 
-      if (histName == names[i]) { nameFound = true; break; } 
+  if (!all)
+    {
+      bool nameFound = false;
+      for(int i=0; i<names.size(); ++i)
+	{
+	  if (histName == names[i]) { nameFound = true; break; }
+	}
+      if (nameFound == false)
+	{ cout << "Make sure the histogram's name is entered correctly!" << endl; usage(); return 1; }
     }
-  if (nameFound == false) 
-    { cout << "Make sure the histogram's name is entered correctly!" << endl; usage(); return 1; }
 
 
   cout << "Accessing text file..." << endl << endl;
   string inputDir = "/afs/cern.ch/user/c/cracz/work/DMC/input/";    //INPUT DIRECTORY
   string sampleName = "hist_output.txt";                          //INPUT FILE
-  ifstream str((inputDir+sampleName).c_str()); 
-  if(str.fail()) 
+  ifstream str((inputDir+sampleName).c_str());
+  if(str.fail())
     { cout << sampleName << " could not be opened!" << endl; return 1; }
 
 
   cout << "Retrieving root file paths..." << endl << endl;
   string temp;
   vector<TString> files;      //Vector of files
-  while(getline(str, temp)) 
+  while(getline(str, temp))
     { files.push_back((TString)temp); }    //fill vectors with paths to files
   if (files.size() == 0)
     { cout << "The text file was empty!" << endl; return 1; }
 
 
-  TFile *f = 0;
-  TH1F *hist = 0;     //Used to transfer the histograms from files to the stack
-  TH1F *hdata = 0;    //Used to get the data histogram
-  THStack *stack  = new THStack("stack",  "Stack");
-  TCanvas *canvas  = new TCanvas("canvas", "Title", 900, 700);
-  TLegend *legend = new TLegend(.65, .65, .9, .9);
+  if (all) gROOT->SetBatch(kTRUE);     //Nothing is shown on the screen, the plots are only saved
+
+  cout << "Accessing files" << (all ? " and reading every histogram..." : "...");
+  vector<HistFile> loaded;
+  if (!loadFiles(files, all ? vector<TString>() : vector<TString>(1, histName), loaded)) return 1;
+  cout << "done" << endl;
+
+  vector<TString> toDraw;             //In alphabetical order
+  if (!all) toDraw.push_back(histName);
+  else
+    for (map<TString, TH1*>::const_iterator it = loaded[0].hists.begin(); it != loaded[0].hists.end(); ++it)
+      {
+	bool everywhere = true;
+	for (int i = 1; i < (int)loaded.size(); ++i) everywhere = everywhere && loaded[i].hists.count(it->first);
+	bool matched = patterns.empty();
+	for (int p = 0; p < (int)patterns.size(); ++p) matched = matched || fnmatch(patterns[p].c_str(), it->first.Data(), 0) == 0;
+	if (everywhere && matched) toDraw.push_back(it->first);
+      }
+  if (toDraw.empty()) { cout << "No histograms to make!" << endl; return 1; }
+
+  cout << "Printing " << toDraw.size() << " histogram" << (toDraw.size() > 1 ? "s" : "");
+  if (nWorkers > 1) cout << " with " << nWorkers << " workers";
+  cout << "..." << endl;
+
+  if (nWorkers > (int)toDraw.size()) nWorkers = toDraw.size();
+  if (nWorkers == 1)
+    {
+      TCanvas *canvas  = new TCanvas("canvas", "Title", 900, 700);
+      for (int h = 0; h < (int)toDraw.size(); ++h) drawStack(toDraw[h], loaded, canvas, title, group, color);
+      delete canvas;
+    }
+  else
+    {
+      cout.flush();
+      vector<pid_t> workers;
+      for (int w = 0; w < nWorkers; ++w)
+	{
+	  pid_t pid = fork();
+	  if (pid < 0) { cout << "Worker " << w << " could not be started!" << endl; break; }
+	  if (pid == 0)             //Worker w draws the histograms w, w+nWorkers, ...
+	    {
+	      TCanvas *canvas  = new TCanvas("canvas", "Title", 900, 700);
+	      for (int h = w; h < (int)toDraw.size(); h += nWorkers) drawStack(toDraw[h], loaded, canvas, title, group, color);
+	      delete canvas;
+	      cout.flush();
+	      _exit(0);
+	    }
+	  workers.push_back(pid);
+	}
 
+      bool ok = ((int)workers.size() == nWorkers);
+      for (int w = 0; w < (int)workers.size(); ++w)
+	{
+	  int status;
+	  waitpid(workers[w], &status, 0);
+	  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) { cout << "Worker " << w << " failed!" << endl; ok = false; }
+	}
+      if (!ok) return 1;
+    }
+  cout << "done" << endl;
+
+  return 0;
+}//End main method
 
-  cout << "Accessing files and printing histograms...";
+
+/*
+  Opens every histogram file once and reads the histograms in names (all of
+  them if names is empty) into memory
+*/
+bool loadFiles(const vector<TString> &files, const vector<TString> &names, vector<HistFile> &loaded)
+{
+  TFile *f = 0;
+  loaded.assign(files.size(), HistFile());
 
   for (int i = 0; i < files.size(); ++i)
     {
-      if (gSystem->AccessPathName(files[i])) { cout << "File " << i+1 << " could not be found!" << endl; return 1; }
-      
+      if (gSystem->AccessPathName(files[i])) { cout << "File " << i+1 << " could not be found!" << endl; return false; }
+
       Ssiz_t lastSlash = files[i].Last('/') + 1;
       Ssiz_t length = files[i].Index(".", 1, lastSlash, TString::kExact) - lastSlash;
-      TString groupName(files[i](lastSlash, length));    //Extract the group name from the file name (ttbar, background, or data)
+      loaded[i].groupName = files[i](lastSlash, length);    //Extract the group name from the file name (ttbar, background, or data)
 
 
-      f = TFile::Open(files[i], "READ");      
+      f = TFile::Open(files[i], "READ");
+      if (!f) { cout << "File " << i+1 << " could not be opened!" << endl; return false; }
 
       gROOT->cd();    /****This is so the histo doesn't die when each file is closed****/
 
-      hist = (TH1F*)f->Get(histName)->Clone();
+      vector<TString> toRead(names);
+      if (toRead.empty())
+	{
+	  TIter next(f->GetListOfKeys());
+	  TKey *key;
+	  while ((key = (TKey*)next()))
+	    if (TString(key->GetClassName()).BeginsWith("TH1")) toRead.push_back(key->GetName());
+	}
+
+      for (int n = 0; n < (int)toRead.size(); ++n)
+	{
+	  if (loaded[i].hists.count(toRead[n])) continue;            //Older cycle of the same key
+	  TObject *obj = f->Get(toRead[n]);
+	  if (!obj) { cout << toRead[n] << " is not in file " << i+1 << "!" << endl; return false; }
+	  TH1 *hist = (TH1*)obj->Clone();
+	  hist->SetDirectory(0);
+	  loaded[i].hists[toRead[n]] = hist;
+	}
 
-      if (groupName == "data") 
-	{ 
-	  hist->SetLineColor(color[groupName]); 
+      f->Close();
+      delete f;
+    }
+  return true;
+}//End method: loadFiles
+
+
+/*
+  Draws the stack of one histogram of every file (data on top, separately)
+  on canvas and saves it as <histName>.png
+*/
+void drawStack(const TString &histName, const vector<HistFile> &loaded, TCanvas *canvas,
+	       map<TString, TString> &title, map<TString, TString> &group, map<TString, Int_t> &color)
+{
+  TH1 *hist = 0;     //Used to transfer the histograms from files to the stack
+  TH1 *hdata = 0;    //Used to get the data histogram
+  THStack *stack  = new THStack("stack",  "Stack");
+  TLegend *legend = new TLegend(.65, .65, .9, .9);
+  vector<TH1*> copies;
+
+  canvas->Clear();
+  canvas->SetLogy(0);
+
+  for (int i = 0; i < loaded.size(); ++i)
+    {
+      TString groupName = loaded[i].groupName;
+      hist = (TH1*)loaded[i].hists.find(histName)->second->Clone();
+      copies.push_back(hist);
+
+      if (groupName == "data")
+	{
+	  hist->SetLineColor(color[groupName]);
 	  hist->SetMarkerStyle(kFullSquare);
 	  hdata = hist;                                 //Get the data so it can be drawn last and separate from the stack
 	  legend->AddEntry(hist, group[groupName]);
-	  f->Close();
 	  continue;
 	}
       else
@@ -146,15 +295,11 @@ int main(int argc, char* argv[])
 	  legend->AddEntry(hist, group[groupName]);
 	  stack->Add(hist);
 	}
-
-      if (i == 1) stack->SetTitle(title[histName]);    //Just to set the title only once
-
-      f->Close();
     }
-  cout << "done" << endl;
+  stack->SetTitle(title.count(histName) ? title[histName] : TString(hist->GetTitle()));
 
   stack->Draw(); canvas->Update();
-  hdata->Draw("E1same"); canvas->Update();       //Draw data last so it's on top
+  if (hdata) { hdata->Draw("E1same"); canvas->Update(); }       //Draw data last so it's on top
   legend->Draw(); canvas->Update();
 
   if (histName.Contains("_pt") || histName.Contains("_m")) canvas->SetLogy();  //Log scale for Pt and Mass
@@ -163,20 +308,25 @@ int main(int argc, char* argv[])
   canvas->SaveAs(imageName);
 
   delete stack;
-  delete canvas;
-  return 0;
-}//End main method
+  delete legend;
+  for (int c = 0; c < (int)copies.size(); ++c) delete copies[c];
+}//End method: drawStack
 
 
 void usage()
 {
-  cout << "Usage: dsbPrint [histo_Name]" << endl << endl
-       << "Accepted histogram names: " << endl 
+  cout << "Usage: dsbPrint [histo_Name]" << endl
+       << "       dsbPrint --all [--match GLOB] [--workers N]" << endl << endl
+       << "Accepted histogram names: " << endl
        << "h_ljet_pt0, h_ljet_pt1" << endl
        << "h_ljet_eta0, h_ljet_eta1" << endl
        << "h_ljet_phi0, h_ljet_phi1" << endl
        << "h_ljet_m0, h_ljet_m1" << endl
        << "h_jet_pt0, h_jet_pt1, h_jet_pt2" << endl
        << "h_jet_eta0, h_jet_eta1, h_jet_eta2" << endl
-       << "h_jet_phi0, h_jet_phi1, h_jet_phi2" << endl;
+       << "h_jet_phi0, h_jet_phi1, h_jet_phi2" << endl << endl
+       << "--all               Make every histogram that is in all of the files," << endl
+       << "                    opening each file only once." << endl
+       << "--match GLOB        With --all, only the histograms matching GLOB, e.g. 'h_ljet_*'." << endl
+       << "--workers N         With --all, draw the plots in N forked processes." << endl;
 }
@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////
+// This program adds up partial histogram files made by dmcHist, e.g. the
+//  <sample>.root files of several batch jobs that each read part of the
+//  input files, into one file that dmcMake and makePlots read the same
+//  way as the output of a single run (see HistFileMerger.h).
+//
+//  The partial files are given on the command line after the name of the
+//  output file, or with "--list FILE", a text file with one path per line
+//  like the ones given to dmcHist. With "--threads N" the files are opened
+//  and the histograms added up by N threads at once; the sums are bin for
+//  bin the same for any number of threads and any order of the files.
+//
+//  Execute the program with no arguments to show a usage statement.
+///////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <stdexcept>
+#include "TROOT.h"
+#include "TH1.h"
+#include "TString.h"
+#include "HistFileMerger.h"
+
+using namespace std;
+
+void usage();
+
+
+int main(int argc, char* argv[])
+{
+  int nThreads = 1;
+  string listName;
+  vector<string> positional;
+
+  for (int a = 1; a < argc; ++a)
+    {
+      string arg(argv[a]);
+
+      if (arg == "--threads" && a+1 < argc) { nThreads = atoi(argv[++a]); }
+      else if (arg == "--list" && a+1 < argc) { listName = argv[++a]; }
+      else if (arg.size() > 1 && arg[0] == '-') { usage(); return 1; }
+      else positional.push_back(arg);
+    }
+  if (positional.empty() || nThreads < 1) { usage(); return 1; }
+
+  TString output(positional[0]);
+  vector<TString> inputs;
+  for (int p = 1; p < (int)positional.size(); ++p) inputs.push_back(positional[p]);
+
+  if (!listName.empty())
+    {
+      ifstream str(listName.c_str());
+      if (str.fail()) { cout << listName << " could not be opened!" << endl; return 1; }
+
+      string temp;
+      while (getline(str, temp))
+	if (!temp.empty()) inputs.push_back((TString)temp);
+    }
+  if (inputs.empty()) { cout << "No files to merge!" << endl; return 1; }
+
+  TH1::AddDirectory(kFALSE);              //The histograms that are read are owned by the merger
+  if (nThreads > 1) ROOT::EnableThreadSafety();
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  try
+    {
+      HistFileMerger merger(inputs, nThreads);
+
+      cout << "Opening " << inputs.size() << " files..." << endl;
+      merger.open();
+
+      cout << "Merging " << merger.nHists() << " histograms (" << merger.nKeys() << " keys) into " << output;
+      if (nThreads > 1) cout << " with " << nThreads << " threads";
+      cout << "..." << endl;
+      merger.merge(output);
+    }
+  catch (invalid_argument &e) { cout << e.what() << endl; return 1; }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << "Finished in " << fixed << setprecision(2) << seconds << " s" << endl;
+  return 0;
+}//End main
+
+
+
+void usage()
+{
+  cout << "Usage: dmcMerge [options] OUTPUT [INPUT ...]" << endl
+       << "Adds up the histograms of the INPUT files (made by dmcHist) into OUTPUT." << endl
+       << "--list FILE         Also merge the files listed in FILE, one per line." << endl
+       << "--threads N         Open and add up the files with N threads." << endl;
+}//End method: usage
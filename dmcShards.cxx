@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////////////////////////////
+// This program runs dmcHist the way a batch array would, on one machine:
+//  the input files are split into N shards ("--shard I/N" of dmcHist), the
+//  N shards run as separate dmcHist processes at the same time, and their
+//  partial outputs are merged into <sample>.root (or <manifest>.root) the
+//  same way dmcMerge does it (see HistFileMerger.h). It is a stand-in for
+//  the multi-node run, to try it out and time it before sending jobs.
+//
+//  The options of dmcHist go after "--", e.g.
+//    dmcShards --shards 4 -- --threads 2 ttbar.txt
+//  The output of every shard goes to <sample>.shardIofN.log, which is
+//  deleted with the partial outputs once the merge is done, unless "--keep"
+//  is given (or a shard fails). The files of "--write-cache", "--plan" and
+//  "--weight-index" are written by every shard with its tag, and are kept.
+//
+//  With "--scaling" the whole run is timed with 1, 2, 4, ... shards up to
+//  the number given, and the speed up over one shard is printed.
+//
+//  Execute the program with no arguments to show a usage statement.
+///////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "TROOT.h"
+#include "TSystem.h"
+#include "TH1.h"
+#include "SampleManifest.h"
+#include "HistFileMerger.h"
+
+using namespace std;
+
+struct ShardTimes
+{
+  double run;                   //Until the last shard finished
+  double fastest;               //Until the first shard finished
+  double merge;
+};
+
+void usage();
+string outputBase(const vector<string> &histArgs);
+bool runShards(const string &exe, const vector<string> &histArgs, const string &base, int nShards, int mergeThreads,
+	       bool keep, ShardTimes &times);
+
+
+int main(int argc, char* argv[])
+{
+  int nShards = 0;
+  int mergeThreads = 1;
+  bool scaling = false;
+  bool keep = false;
+  string exe = "./dmcHist";
+  vector<string> histArgs;
+
+  int a = 1;
+  for (; a < argc; ++a)
+    {
+      string arg(argv[a]);
+
+      if (arg == "--") { ++a; break; }
+      else if (arg == "--shards" && a+1 < argc) { nShards = atoi(argv[++a]); }
+      else if (arg == "--merge-threads" && a+1 < argc) { mergeThreads = atoi(argv[++a]); }
+      else if (arg == "--scaling") { scaling = true; }
+      else if (arg == "--keep") { keep = true; }
+      else if (arg == "--exe" && a+1 < argc) { exe = argv[++a]; }
+      else { usage(); return 1; }
+    }
+  for (; a < argc; ++a) histArgs.push_back(argv[a]);
+
+  string base = outputBase(histArgs);
+  if (nShards < 1 || mergeThreads < 1 || base.empty()) { usage(); return 1; }
+  for (int h = 0; h < (int)histArgs.size(); ++h)
+    if (histArgs[h] == "--shard" || histArgs[h] == "--index-only") { usage(); return 1; }
+
+  TH1::AddDirectory(kFALSE);
+  if (mergeThreads > 1) ROOT::EnableThreadSafety();
+
+  vector<int> counts;               //Numbers of shards to run with
+  if (scaling)
+    for (int n = 1; n < nShards; n *= 2) counts.push_back(n);
+  counts.push_back(nShards);
+
+  vector<ShardTimes> times(counts.size());
+  for (int c = 0; c < (int)counts.size(); ++c)
+    {
+      cout << "Running " << counts[c] << " shard" << (counts[c] > 1 ? "s" : "") << " of " << exe << "..." << endl;
+      if (!runShards(exe, histArgs, base, counts[c], mergeThreads, keep, times[c])) return 1;
+      cout << fixed << setprecision(2)
+	   << "  shards done in " << times[c].run << " s (first after " << times[c].fastest << " s), merged in "
+	   << times[c].merge << " s" << endl << endl;
+      cout.unsetf(ios::fixed);
+    }
+
+  if (scaling)
+    {
+      double one = times[0].run + times[0].merge;
+      cout << "Shards      Run s    Merge s    Total s   Speed up   Efficiency" << endl << fixed;
+      for (int c = 0; c < (int)counts.size(); ++c)
+	{
+	  double total = times[c].run + times[c].merge;
+	  cout << setw(6) << counts[c] << setprecision(2) << setw(11) << times[c].run << setw(11) << times[c].merge
+	       << setw(11) << total << setw(10) << one/total << "x" << setprecision(0) << setw(12)
+	       << 100*one/total/counts[c] << "%" << endl;
+	}
+    }
+
+  cout << "Finished, histograms saved in " << base << ".root" << endl;
+  return 0;
+}//End main
+
+
+/*
+  The name dmcHist gives its output file, without ".root": the manifest or
+  the text file without its extension. Every option of dmcHist except
+  --bulk and --index-only takes a value.
+*/
+string outputBase(const vector<string> &histArgs)
+{
+  string name;
+  for (int h = 0; h < (int)histArgs.size(); ++h)
+    {
+      const string &arg = histArgs[h];
+      if (arg == "--manifest" && h+1 < (int)histArgs.size()) { name = histArgs[++h]; break; }
+      else if (arg == "--bulk" || arg == "--index-only") continue;
+      else if (arg.substr(0, 2) == "--") ++h;
+      else if (name.empty()) name = arg;
+    }
+  return name.substr(0, name.find_last_of("."));
+}
+
+
+/*
+  Starts the nShards shards of dmcHist at once, waits for them, and merges
+  their outputs into base.root. Returns false if a shard or the merge
+  failed.
+*/
+bool runShards(const string &exe, const vector<string> &histArgs, const string &base, int nShards, int mergeThreads,
+	       bool keep, ShardTimes &times)
+{
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<pid_t> pids(nShards, -1);
+
+  for (int i = 0; i < nShards; ++i)
+    {
+      string tag = nShards > 1 ? shardTag(i, nShards) : "";
+      stringstream shard;
+      shard << i << "/" << nShards;
+
+      vector<string> args(1, exe);
+      args.insert(args.end(), histArgs.begin(), histArgs.end());
+      args.push_back("--shard");
+      args.push_back(shard.str());
+
+      pids[i] = fork();
+      if (pids[i] < 0) { cout << "Shard " << i << " could not be started!" << endl; return false; }
+      if (pids[i] == 0)
+	{
+	  int log = open((base + tag + ".log").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	  if (log >= 0) { dup2(log, 1); dup2(log, 2); close(log); }
+
+	  vector<char*> argv;
+	  for (int n = 0; n < (int)args.size(); ++n) argv.push_back(const_cast<char*>(args[n].c_str()));
+	  argv.push_back(0);
+	  execv(exe.c_str(), &argv[0]);
+	  _exit(127);                   //Only if exe couldn't be run
+	}
+    }
+
+  bool ok = true;
+  for (int done = 0; done < nShards; ++done)
+    {
+      int status;
+      pid_t pid = wait(&status);
+      if (done == 0) times.fastest = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+      int i = 0;
+      while (i < nShards && pids[i] != pid) ++i;
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+	  cout << "Shard " << i << " failed, see " << base << (nShards > 1 ? shardTag(i, nShards) : "") << ".log" << endl;
+	  ok = false;
+	}
+    }
+  times.run = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  times.merge = 0;
+  if (!ok) return false;
+
+  vector<TString> parts;
+  for (int i = 0; i < nShards; ++i)
+    if (nShards > 1) parts.push_back((base + shardTag(i, nShards) + ".root").c_str());
+
+  if (!parts.empty())                   //One shard writes base.root itself
+    {
+      start = chrono::steady_clock::now();
+      try
+	{
+	  HistFileMerger merger(parts, mergeThreads);
+	  merger.merge((base + ".root").c_str());
+	}
+      catch (invalid_argument &e) { cout << e.what() << endl; return false; }
+      times.merge = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+  if (!keep)
+    for (int i = 0; i < nShards; ++i)
+      {
+	string name = base + (nShards > 1 ? shardTag(i, nShards) : "");
+	if (nShards > 1) gSystem->Unlink((name + ".root").c_str());
+	gSystem->Unlink((name + ".log").c_str());
+      }
+  return true;
+}//End method: runShards
+
+
+
+void usage()
+{
+  cout << "Usage: dmcShards --shards N [--scaling] [--keep] [--merge-threads M] [--exe PATH] -- [dmcHist options]" << endl
+       << "Runs N shards of dmcHist (\"--shard I/N\") as separate processes and merges" << endl
+       << "their outputs into <sample>.root." << endl
+       << "--shards N          Number of shards (processes)." << endl
+       << "--scaling           Time the run with 1, 2, 4, ... shards up to N." << endl
+       << "--keep              Keep the partial outputs and the logs of the shards." << endl
+       << "--merge-threads M   Merge the partial outputs with M threads." << endl
+       << "--exe PATH          dmcHist to run (./dmcHist by default)." << endl;
+}//End method: usage
@@ -0,0 +1,349 @@
+///////////////////////////////////////////////////////////////////////////
+// This program measures the throughput of the dmcHist event loop on
+//  synthetic input files (see NtupleGenerator.h), for every combination
+//  of file size, read strategy and number of threads, and writes the
+//  results as JSON so runs on different machines or commits can be
+//  compared by a script.
+//
+//  For each "--events" value a set of "--files" files with that many
+//  events each is generated in DIR (once; later runs reuse it), and
+//  dmcHist is run on it as a separate process with each strategy:
+//
+//    getentry  GetEntry for every event (the default of dmcHist)
+//    bulk      --bulk, events read in batches branch by branch
+//    prefetch  --prefetch 2, files opened ahead in the background
+//    shared    --fill-mode shards, one shared set of histograms
+//
+//  and each number of threads. The first run on every set is repeated
+//  untimed first, so all of the timed runs read the files from the page
+//  cache. For every run the wall time, events/s, MB/s (compressed bytes of
+//  the branches dmcHist reads, and of the whole files) and the peak memory
+//  of dmcHist are printed and saved.
+//
+//  Execute the program with no arguments to show a usage statement.
+///////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <climits>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "TROOT.h"
+#include "TSystem.h"
+#include "NtupleGenerator.h"
+#include "SampleManifest.h"
+#include "FilePlan.h"
+
+using namespace std;
+
+struct Dataset
+{
+  Long64_t eventsPerFile;
+  string dir;
+  Long64_t events;              //In all of the files
+  Long64_t fileBytes;
+  Long64_t readBytes;           //Compressed bytes of the branches dmcHist reads
+};
+
+struct Run
+{
+  int dataset;
+  string mode;
+  int threads;
+  int repeat;
+  bool ok;
+  double seconds;
+  double maxRSS;                //MB
+};
+
+void usage();
+vector<Long64_t> parseList(const string &text);
+bool makeDataset(const string &dir, int nFiles, NtupleGenerator &gen, Dataset &data);
+bool modeArgs(const string &mode, vector<string> &args);
+bool runHist(const string &exe, const Dataset &data, const vector<string> &args, int threads, Run &run);
+bool writeJSON(const string &path, const vector<Dataset> &datasets, const vector<Run> &runs, const NtupleGenerator &gen, int nFiles);
+
+
+int main(int argc, char* argv[])
+{
+  string dir = "dmc_bench";
+  string exe = "./dmcHist";
+  string outName = "bench.json";
+  int nFiles = 4;
+  int nRepeats = 1;
+  vector<Long64_t> eventList = parseList("20000,200000");
+  vector<Long64_t> threadList;
+  vector<string> modes;
+  NtupleGenerator gen;
+
+  for (int a = 1; a < argc; ++a)
+    {
+      string arg(argv[a]);
+
+      if (arg == "--dir" && a+1 < argc) { dir = argv[++a]; }
+      else if (arg == "--exe" && a+1 < argc) { exe = argv[++a]; }
+      else if (arg == "--out" && a+1 < argc) { outName = argv[++a]; }
+      else if (arg == "--files" && a+1 < argc) { nFiles = atoi(argv[++a]); }
+      else if (arg == "--repeat" && a+1 < argc) { nRepeats = atoi(argv[++a]); }
+      else if (arg == "--events" && a+1 < argc) { eventList = parseList(argv[++a]); }
+      else if (arg == "--threads" && a+1 < argc) { threadList = parseList(argv[++a]); }
+      else if (arg == "--modes" && a+1 < argc)
+	{
+	  stringstream list(argv[++a]);
+	  string mode;
+	  while (getline(list, mode, ',')) modes.push_back(mode);
+	}
+      else if (arg == "--compression" && a+1 < argc) { gen.compression = atoi(argv[++a]); }
+      else if (arg == "--extra" && a+1 < argc) { gen.nExtra = atoi(argv[++a]); }
+      else { usage(); return 1; }
+    }
+
+  if (threadList.empty())
+    {
+      int maxThreads = thread::hardware_concurrency();
+      for (int t = 1; t < maxThreads; t *= 2) threadList.push_back(t);
+      threadList.push_back(maxThreads > 1 ? maxThreads : 1);
+    }
+  if (modes.empty()) { modes.push_back("getentry"); modes.push_back("bulk"); modes.push_back("prefetch"); }
+
+  vector<string> unused;
+  bool ok = (nFiles > 0 && nRepeats > 0 && !eventList.empty() && gen.nExtra >= 0);
+  for (int e = 0; e < (int)eventList.size(); ++e) ok = ok && eventList[e] > 0;
+  for (int t = 0; t < (int)threadList.size(); ++t) ok = ok && threadList[t] > 0;
+  for (int m = 0; m < (int)modes.size(); ++m) ok = ok && modeArgs(modes[m], unused);
+  if (!ok) { usage(); return 1; }
+
+  char path[PATH_MAX];
+  if (!realpath(exe.c_str(), path)) { cout << exe << " could not be found!" << endl; return 1; }
+  exe = path;
+  gSystem->mkdir(dir.c_str(), kTRUE);
+  if (!realpath(dir.c_str(), path)) { cout << dir << " could not be made!" << endl; return 1; }
+  dir = path;
+
+  gROOT->ProcessLine("#include <vector>"); //Problems occur with the branches of vector<float> without this line
+
+  vector<Dataset> datasets(eventList.size());
+  for (int d = 0; d < (int)datasets.size(); ++d)
+    {
+      stringstream name;
+      name << dir << "/ev" << eventList[d] << "_c" << gen.compression << "_x" << gen.nExtra;
+      datasets[d].eventsPerFile = eventList[d];
+      if (!makeDataset(name.str(), nFiles, gen, datasets[d])) return 1;
+    }
+  cout << endl;
+
+  vector<Run> runs;
+  cout << " events/file         mode  threads    time (s)   k events/s  MB/s read  MB/s files   peak MB" << endl;
+  for (int d = 0; d < (int)datasets.size(); ++d)
+    {
+      for (int m = 0; m < (int)modes.size(); ++m)
+	for (int t = 0; t < (int)threadList.size(); ++t)
+	  for (int r = (m == 0 && t == 0) ? -1 : 0; r < nRepeats; ++r)     //-1 warms the page cache
+	    {
+	      vector<string> args;
+	      modeArgs(modes[m], args);
+	      Run run;
+	      run.dataset = d; run.mode = modes[m]; run.threads = threadList[t]; run.repeat = r;
+	      if (!runHist(exe, datasets[d], args, run.threads, run))
+		cout << "dmcHist failed, see " << datasets[d].dir << "/dmcHist.log" << endl;
+	      if (r < 0) continue;
+	      runs.push_back(run);
+
+	      const Dataset &data = datasets[d];
+	      cout << setw(12) << data.eventsPerFile << setw(13) << run.mode << setw(9) << run.threads << fixed
+		   << setprecision(3) << setw(12) << run.seconds << setprecision(1) << setw(13) << data.events/run.seconds/1e3
+		   << setw(11) << data.readBytes/run.seconds/1e6 << setw(12) << data.fileBytes/run.seconds/1e6
+		   << setw(10) << run.maxRSS << (run.ok ? "" : "  FAILED") << endl;
+	      cout.unsetf(ios::fixed);
+	    }
+    }
+
+  if (!writeJSON(outName, datasets, runs, gen, nFiles)) { cout << outName << " could not be written!" << endl; return 1; }
+  cout << endl << "Results saved in " << outName << endl;
+  return 0;
+}//End main
+
+
+/*
+  Reads a list of numbers separated by commas
+*/
+vector<Long64_t> parseList(const string &text)
+{
+  vector<Long64_t> values;
+  stringstream list(text);
+  string value;
+  while (getline(list, value, ',')) values.push_back(atoll(value.c_str()));
+  return values;
+}//End method: parseList
+
+
+/*
+  Generates the files of a dataset in dir, unless its list is already
+  there, and works out its size
+*/
+bool makeDataset(const string &dir, int nFiles, NtupleGenerator &gen, Dataset &data)
+{
+  data.dir = dir;
+  string listName = dir + "/gen.txt";
+
+  vector<TString> files;
+  bool have = !gSystem->AccessPathName(listName.c_str());
+  if (have)
+    {
+      readFileList(listName, files);
+      have = ((int)files.size() == nFiles);
+      for (int i = 0; have && i < nFiles; ++i) have = !gSystem->AccessPathName(files[i]);
+    }
+
+  if (!have)
+    {
+      cout << "Generating " << nFiles << " files of " << data.eventsPerFile << " events in " << dir << "..." << endl;
+      gSystem->mkdir(dir.c_str(), kTRUE);
+      files.clear();
+      ofstream list(listName.c_str());
+      for (int i = 0; i < nFiles; ++i)
+	{
+	  files.push_back(TString::Format("%s/gen_%d.root", dir.c_str(), i));
+	  if (!gen.write(files[i], data.eventsPerFile, i+1)) { cout << files[i] << " could not be written!" << endl; return false; }
+	  list << files[i] << endl;
+	}
+      if (list.fail()) { cout << listName << " could not be written!" << endl; return false; }
+    }
+
+  vector<int> all;
+  for (int i = 0; i < nFiles; ++i) all.push_back(i);
+  vector<FileInfo> info;
+  scanFiles(files, all, vector<bool>(nFiles, false), 1, 0, info);
+
+  data.events = data.fileBytes = data.readBytes = 0;
+  for (int i = 0; i < nFiles; ++i)
+    {
+      if (info[i].status != FileInfo::kGood) { cout << files[i] << " is " << statusName(info[i].status) << "!" << endl; return false; }
+      data.events += info[i].entries;
+      data.fileBytes += info[i].fileBytes;
+      data.readBytes += info[i].cost;
+    }
+
+  cout << "  " << data.events << " events, " << fixed << setprecision(1) << data.fileBytes/1e6 << " MB ("
+       << data.readBytes/1e6 << " MB read by dmcHist)" << endl;
+  cout.unsetf(ios::fixed);
+  return true;
+}//End method: makeDataset
+
+
+/*
+  The options of dmcHist for a read strategy. Returns false if there is no
+  such strategy.
+*/
+bool modeArgs(const string &mode, vector<string> &args)
+{
+  if (mode == "getentry") return true;
+  if (mode == "bulk") { args.push_back("--bulk"); return true; }
+  if (mode == "prefetch") { args.push_back("--prefetch"); args.push_back("2"); return true; }
+  if (mode == "shared") { args.push_back("--fill-mode"); args.push_back("shards"); return true; }
+  return false;
+}//End method: modeArgs
+
+
+/*
+  Runs dmcHist on a dataset, in the dataset's directory (so its output goes
+  there too), and fills in the time and peak memory of run
+*/
+bool runHist(const string &exe, const Dataset &data, const vector<string> &args, int threads, Run &run)
+{
+  stringstream nThreads;
+  nThreads << threads;
+
+  vector<string> all(1, exe);
+  all.push_back("--input-dir"); all.push_back(data.dir);
+  all.push_back("--threads"); all.push_back(nThreads.str());
+  all.insert(all.end(), args.begin(), args.end());
+  all.push_back("gen.txt");
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0) { run.ok = false; run.seconds = 0; run.maxRSS = 0; return false; }
+  if (pid == 0)
+    {
+      if (chdir(data.dir.c_str()) != 0) _exit(127);
+      int log = open("dmcHist.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (log >= 0) { dup2(log, 1); dup2(log, 2); close(log); }
+
+      vector<char*> argv;
+      for (int n = 0; n < (int)all.size(); ++n) argv.push_back(const_cast<char*>(all[n].c_str()));
+      argv.push_back(0);
+      execv(exe.c_str(), &argv[0]);
+      _exit(127);
+    }
+
+  int status;
+  struct rusage resources;
+  wait4(pid, &status, 0, &resources);
+  run.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  run.maxRSS = resources.ru_maxrss/1024.0;                //ru_maxrss is in kB on Linux
+  run.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  return run.ok;
+}//End method: runHist
+
+
+/*
+  Writes the machine, the datasets and every timed run as JSON
+*/
+bool writeJSON(const string &path, const vector<Dataset> &datasets, const vector<Run> &runs, const NtupleGenerator &gen, int nFiles)
+{
+  ofstream str(path.c_str());
+  if (str.fail()) return false;
+
+  char host[256] = "";
+  gethostname(host, sizeof(host)-1);
+
+  str << "{" << endl
+      << "  \"host\": \"" << host << "\"," << endl
+      << "  \"cores\": " << thread::hardware_concurrency() << "," << endl
+      << "  \"compression\": " << gen.compression << "," << endl
+      << "  \"extra_branches\": " << gen.nExtra << "," << endl
+      << "  \"files\": " << nFiles << "," << endl
+      << "  \"runs\": [";
+
+  str << setprecision(6);
+  for (int r = 0; r < (int)runs.size(); ++r)
+    {
+      const Run &run = runs[r];
+      const Dataset &data = datasets[run.dataset];
+      str << (r ? "," : "") << endl
+	  << "    {\"events_per_file\": " << data.eventsPerFile << ", \"events\": " << data.events
+	  << ", \"file_mb\": " << data.fileBytes/1e6 << ", \"read_mb\": " << data.readBytes/1e6
+	  << ", \"mode\": \"" << run.mode << "\", \"threads\": " << run.threads << ", \"repeat\": " << run.repeat
+	  << ", \"ok\": " << (run.ok ? "true" : "false") << ", \"seconds\": " << run.seconds
+	  << ", \"events_per_s\": " << data.events/run.seconds << ", \"read_mb_per_s\": " << data.readBytes/run.seconds/1e6
+	  << ", \"file_mb_per_s\": " << data.fileBytes/run.seconds/1e6 << ", \"peak_rss_mb\": " << run.maxRSS << "}";
+    }
+  str << endl << "  ]" << endl << "}" << endl;
+  return !str.fail();
+}//End method: writeJSON
+
+
+
+void usage()
+{
+  cout << "Usage: dmcSuite [options]" << endl
+       << "Times dmcHist on synthetic files for every file size, strategy and thread count." << endl
+       << "--dir DIR           Where the synthetic files are kept (dmc_bench)." << endl
+       << "--exe PATH          dmcHist to run (./dmcHist)." << endl
+       << "--out FILE          JSON file for the results (bench.json)." << endl
+       << "--files N           Files in every dataset (4)." << endl
+       << "--events LIST       Events per file of each dataset, e.g. 20000,200000." << endl
+       << "--threads LIST      Thread counts, e.g. 1,2,4 (1, 2, 4, ... up to the cores)." << endl
+       << "--modes LIST        Strategies: getentry, bulk, prefetch, shared (getentry,bulk,prefetch)." << endl
+       << "--repeat R          Timed runs of every combination (1)." << endl
+       << "--compression C     ROOT compression settings of the files (101)." << endl
+       << "--extra N           Unread branches in the files (20)." << endl;
+}//End method: usage
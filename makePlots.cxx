@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////
+// This program makes the data/MC plots of the histogram files of the
+//  ttbar semileptonic samples: the stacked plots with their Data/SM
+//  ratio, the 2D plots, or the plots of the dR12 sections ("FLAG"). It is
+//  the compiled version of the make_plots.C macro; the plotting itself is
+//  in make_plots.cxx, and the plots are the same as the macro made.
+//
+//  The first argument chooses the signal (0 for the nominal ttbar sample,
+//  1-4 for syst_410001-410004) and the second one the set of plots (s for
+//  the stacks, t for 2D, f for FLAG), as the two parameters of the macro.
+//  The signal can also be a list like 0,2,4 or "all" for the five of them:
+//  they are then plotted in one run, reading, adding up and scaling the
+//  backgrounds of every key only once for all of them. The directories of
+//  the files are set at the top of make_plots().
+//
+//  The histograms are read only when they are plotted, keeping at most
+//  "--cache-mb" MB of them in memory (500 by default), and the ones of the
+//  next "--prefetch" keys (2 by default, 0 for none) are read by a thread
+//  while a plot is drawn (see LazyHists.h).
+//
+//  Execute the program with "--help" to show a usage statement.
+///////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sstream>
+#include "TROOT.h"
+#include "make_plots.h"
+
+using namespace std;
+
+void usage();
+
+
+int main(int argc, char* argv[])
+{
+  vector<int> sig_params(1, 0);
+  char set_param = 's';
+  double cacheMB = 500;
+  int prefetch = 2;
+  vector<string> positional;
+
+  for (int a = 1; a < argc; ++a)
+    {
+      string arg(argv[a]);
+
+      if (arg == "--cache-mb" && a+1 < argc) { cacheMB = atof(argv[++a]); }
+      else if (arg == "--prefetch" && a+1 < argc) { prefetch = atoi(argv[++a]); }
+      else if (arg.substr(0, 2) != "--" && positional.size() < 2) { positional.push_back(arg); }
+      else { usage(); return 1; }
+    }
+  if (cacheMB < 0 || prefetch < 0) { usage(); return 1; }
+
+  if (positional.size() > 0)
+    {
+      sig_params.clear();
+      if (positional[0] == "all")
+	for (int s = 0; s < 5; ++s) sig_params.push_back(s);
+      else
+	{
+	  stringstream list(positional[0]);
+	  string item;
+	  while (getline(list, item, ','))
+	    {
+	      if (item.size() != 1 || item[0] < '0' || item[0] > '9') { usage(); return 1; }
+	      sig_params.push_back(atoi(item.c_str()));
+	    }
+	}
+    }
+  if (positional.size() > 1)
+    {
+      if (positional[1].size() != 1) { usage(); return 1; }
+      set_param = positional[1][0];
+    }
+  if (sig_params.empty()) { usage(); return 1; }
+  for (int s = 0; s < (int)sig_params.size(); ++s)
+    if (!check_input(sig_params[s], set_param)) { usage(); return 1; }
+
+  gROOT->SetBatch(kTRUE);                 //The plots are only saved
+  make_plots(sig_params, set_param, cacheMB, prefetch);
+
+  return 0;
+}//End main
+
+
+
+void usage()
+{
+  cout << "Usage: makePlots [--cache-mb MB] [--prefetch N] [sig_param] [set_param]" << endl
+       << "sig_param       Signal sample: 0 = nominal (default), 1-4 = syst_410001-410004," << endl
+       << "                a list like 0,2,4, or all." << endl
+       << "set_param       Plots to make: s = stacks (default), t = 2D, f = FLAG (dR12 sections)." << endl
+       << "--cache-mb MB   Keep at most MB of histograms in memory (500 by default, 0 for no limit)." << endl
+       << "--prefetch N    Read the histograms of the next N keys ahead (2 by default, 0 for none)." << endl;
+}//End method: usage
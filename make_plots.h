@@ -0,0 +1,141 @@
+//////
+//The plotting code of makePlots (it used to be the make_plots.C macro):
+//stacked data/MC plots, 2D plots and the "FLAG" plots of the histogram
+//files of the ttbar semileptonic samples.
+//
+//Every sample is a Hist, with its file, its colour and its histograms.
+//The six samples of a run are kept in one SampleRegistry, which is passed
+//by reference to every function, so the histogram maps and the lists of
+//names are never copied, however many keys are plotted. order points into
+//the registry, so the MC histograms that are stacked are the same objects
+//as in samples.
+//
+//The histograms are read from the files only when they are first used,
+//and at most cache_mb of them are kept, shared out between the samples
+//(see LazyHists.h). While a plot is drawn, a thread reads the histograms
+//of the next prefetch keys; the loops over the keys tell it where they
+//are with advance().
+//
+//Several signal samples can be plotted in one run. The keys are then
+//gone through once, and every signal is plotted for a key before the next
+//one, so the backgrounds of a key are read, summed and scaled only once
+//for all of them. The registry keeps that sum for the key being plotted,
+//and the scale factors for the whole run (SF_bkg once, SF_ttbar once for
+//every signal), see combine_backgrounds() and calc_SFs().
+//
+//make_plots(sig_param, set_param) makes the plots of one run. It is also
+//what ".L LazyHists.cxx+" and ".L make_plots.cxx+" give in ROOT, for
+//using it interactively.
+//////
+
+#ifndef MAKE_PLOTS_H
+#define MAKE_PLOTS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include "TFile.h"
+#include "TH1.h"
+#include "THStack.h"
+#include "LazyHists.h"
+using std::string;
+using std::vector;
+using std::map;
+
+
+struct Hist{
+
+  //data type(0-data, 1-sig, 2-background)
+  string name;
+  int data_type;
+  TFile* file;
+  int color;
+  vector<string> hist_names;
+  LazyHists histograms;         //Read from file when they are first used
+
+  //Setup the new hist
+  void init(const string &name_in, int data_type_in, TFile* file_in, const vector<string> &hist_names_in, int color_in){
+    this->name = name_in;
+    this->data_type = data_type_in;
+    this->file = file_in;
+    this->hist_names = hist_names_in;
+    this->color = color_in;
+    this->histograms.attach(file_in, 0);
+  }
+};
+
+
+struct SampleRegistry{
+  vector<Hist> samples;         //Data, the backgrounds and the signals
+  vector<Hist*> order;          //The backgrounds and the signal being plotted, in the order they are stacked
+  vector<int> signals;          //The indices of the signal samples in samples
+  vector<int> sig_params;       //and the sig_param of each of them
+  int signal;                   //The index in samples of the signal being plotted
+  HistPrefetcher* prefetcher;   //0 if the next keys aren't read ahead
+
+  //Worked out once (see calc_SFs() and combine_backgrounds())
+  bool SF_found;
+  bool use_sumw;                //Normalise with the sumw of the samples instead of h_INTEGRAL
+  double I_data;
+  double SF_bkg;
+  map<int, double> SF_ttbar;    //By signal sample
+  string bkg_key;               //The key of bkg_sum
+  TH1* bkg_sum;                 //The unscaled sum of the backgrounds of bkg_key
+  string scaled_key;            //The key whose backgrounds are scaled by SF_bkg already
+
+  SampleRegistry() : signal(-1), prefetcher(0), SF_found(false), use_sumw(false), I_data(0), SF_bkg(0), bkg_sum(0) {}
+  ~SampleRegistry() { delete prefetcher; delete bkg_sum; }
+
+  //Plot the signal s of signals next
+  void set_signal(int s){
+    signal = signals[s];
+    order.back() = &samples[signal];
+  }
+  Hist& signal_sample(){ return samples[signal]; }
+
+  //Keep at most max_mb of histograms in memory (0 for no limit)
+  void limit_memory(double max_mb){
+    for(unsigned i = 0; i<samples.size(); ++i)
+      samples[i].histograms.attach(samples[i].file, (Long64_t)(max_mb*1e6/samples.size()));
+  }
+
+  //Read the histograms of the next depth keys of hist_names in the background
+  void start_prefetch(int depth){
+    vector<string> paths;
+    for(unsigned i = 0; i<samples.size(); ++i) paths.push_back(samples[i].file->GetName());
+    prefetcher = new HistPrefetcher(paths, samples[0].hist_names, depth);
+    for(unsigned i = 0; i<samples.size(); ++i) samples[i].histograms.setPrefetcher(prefetcher, i);
+  }
+
+  //The plots have moved on to the key key_index of hist_names
+  void advance(int key_index){
+    if(prefetcher) prefetcher->advance(key_index);
+  }
+};
+
+
+void make_plots(int sig_param = 0, char set_param = 's', double cache_mb = 500, int prefetch = 2);
+void make_plots(const vector<int> &sig_params, char set_param, double cache_mb = 500, int prefetch = 2);
+bool check_input(int sig_param, char set_param);
+void plot_stack(SampleRegistry &registry, const string &save_dir);
+void plot_2D(SampleRegistry &registry, const string &save_dir);
+void plot_flags(SampleRegistry &registry, const string &save_dir, int sig_param);
+vector<string> make_stack_hist_names(const string &keyFilePath);
+vector<string> make_2D_hist_names(const string &keyFilePath);
+vector<string> make_nostack_hist_names(const string &keyFilePath);
+vector<string> make_flag_hist_names(const string &keyFilePath);
+TH1* make_sb_hist(TH1* data, TH1* scaledMC);
+TH1* combine_MC(SampleRegistry &registry, const string &key);
+TH1* combine_backgrounds(SampleRegistry &registry, const string &key);
+//TH2* combine_backgrounds_2D(SampleRegistry &registry, const string &key);
+int find_max(SampleRegistry &registry, TH1* tot_back, const string &key);
+double calc_SF_ttbar(TH1* data, TH1* signal);
+double calc_SF_bkg(TH1* data, TH1* bkg);
+double unselected_sumw(Hist &h);
+double sample_integral(Hist &h, bool use_sumw);
+void calc_SFs(SampleRegistry &registry, double &SF_ttbar, double &SF_bkg);
+THStack* make_stack(const string &key, SampleRegistry &registry);
+
+
+
+#endif /*MAKE_PLOTS_H*/